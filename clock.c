@@ -1,6 +1,6 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
+ *           ARMv8, Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -9,14 +9,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
+/* Helpers for estimating counter rates (defined below) */
+static double mono_secs(void);
+static double counter_mhz(double (*counter)(void), double secs);
+
 
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__, __aarch64__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
@@ -71,6 +76,77 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+/* Initialize the cycle counter */
+static unsigned long long cyc_start = 0;
+
+/* Read the 64-bit time stamp counter. rdtscp waits for all earlier
+   instructions to finish before reading the counter; the lfence 
+   before it also holds back earlier loads, and the lfence after it 
+   keeps later instructions from starting until the read is done. */
+static unsigned long long access_counter(void)
+{
+    unsigned hi, lo;
+
+    asm volatile("lfence; rdtscp; lfence"
+		 : "=a" (lo), "=d" (hi)
+		 : /* No input */
+		 : "%rcx", "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = access_counter();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(access_counter() - cyc_start);
+}
+
+#elif defined(__aarch64__)
+/*******************************************************
+ * ARMv8 versions of start_counter() and get_counter()
+ *
+ * These read the virtual counter, which ticks at a fixed 
+ * frequency (cntfrq_el0) rather than at the core clock, so 
+ * "cycles" here are counter ticks. mhz() measures their 
+ * rate, so times in seconds come out right.
+ *******************************************************/
+
+/* Initialize the cycle counter */
+static unsigned long long cyc_start = 0;
+
+/* Read the virtual counter. The isb before the read keeps it from 
+   being taken early, and the isb after it keeps later instructions
+   from starting before it. */
+static unsigned long long access_counter(void)
+{
+    unsigned long long val;
+
+    asm volatile("isb; mrs %0, cntvct_el0; isb" : "=r" (val) : : "memory");
+    return val;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = access_counter();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(access_counter() - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -163,9 +239,94 @@ double get_counter()
 
 
 
+/*******************************************************
+ * Free-running tick counter for timing very short events,
+ * such as a single malloc call. Reads the time stamp counter
+ * on x86, the virtual counter on ARMv8, and falls back to 
+ * clock_gettime (in nanoseconds) everywhere else.
+ *******************************************************/
+
+unsigned long long read_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned hi, lo;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long)hi << 32) | lo;
+#elif defined(__aarch64__)
+    unsigned long long val;
+
+    asm volatile("mrs %0, cntvct_el0" : "=r" (val));
+    return val;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Measure the cost of reading the tick counter: the smallest 
+   difference seen between back-to-back reads */
+double ticks_ovhd(void)
+{
+    int i;
+    unsigned long long t0, t1, best = ~0ULL;
+
+    for (i = 0; i < 1000; i++) {
+	t0 = read_ticks();
+	t1 = read_ticks();
+	if (t1 - t0 < best)
+	    best = t1 - t0;
+    }
+    return (double)best;
+}
+
+/* Read the tick counter as a double, for counter_mhz() */
+static double ticks_now(void)
+{
+    return (double)read_ticks();
+}
+
+/* Estimate the tick rate (in MHz) against the monotonic clock */
+double ticks_mhz(void)
+{
+    static double rate = 0.0;
+
+    if (rate <= 0.0)
+	rate = counter_mhz(ticks_now, 0.05);
+    return rate;
+}
+
+
 /*******************************
  * Machine-independent functions
  ******************************/
+
+/* Return the monotonic clock in seconds */
+static double mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/* Measure how fast counter() advances (in MHz) by busy-waiting for 
+   secs seconds of monotonic time between two reads of it */
+static double counter_mhz(double (*counter)(void), double secs)
+{
+    double t0, t1, c0, c1;
+
+    t0 = mono_secs();
+    c0 = counter();
+    do {
+	t1 = mono_secs();
+    } while (t1 - t0 < secs);
+    c1 = counter();
+    return (c1 - c0) / (1e6*(t1 - t0));
+}
+
 double ovhd()
 {
     /* Do it twice to eliminate cache effects */
@@ -181,24 +342,31 @@ double ovhd()
 
 /* $begin mhz */
 /* Estimate the clock rate by measuring the cycles that elapse */ 
-/* while sleeping for sleeptime seconds */
-double mhz_full(int verbose, int sleeptime)
+/* during secs seconds, as timed by clock_gettime */
+static double mhz_secs(int verbose, double secs)
 {
     double rate;
 
     start_counter();
-    sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
+    rate = counter_mhz(get_counter, secs);
     if (verbose) 
 	printf("Processor clock rate ~= %.1f MHz\n", rate);
     return rate;
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* Version with more control over accuracy */
+double mhz_full(int verbose, int sleeptime)
+{
+    return mhz_secs(verbose, (double)sleeptime);
+}
+
+/* Version using a default measurement interval of 100 ms. Since
+   the interval is timed by clock_gettime rather than assumed, 
+   this is as accurate as sleeping for seconds used to be. */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    return mhz_secs(verbose, 0.1);
 }
 
 /** Special counters that compensate for timer interrupt overhead */
@@ -20,3 +20,14 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+/** Free-running tick counter for timing very short events */
+
+/* Read the tick counter (TSC on x86) */
+unsigned long long read_ticks(void);
+
+/* Measure overhead of reading the tick counter, in ticks */
+double ticks_ovhd(void);
+
+/* Determine the rate of the tick counter in MHz */
+double ticks_mhz(void);
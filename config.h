@@ -63,10 +63,100 @@
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
 /*****************************************************************************
- * Set exactly one of these USE_xxx constants to "1" to select a timing method
+ * Set exactly one of these USE_xxx constants to "1" to select a timing method.
+ * By default, use the cycle counter where clock.c can read it with proper
+ * serialization (x86-64 and ARMv8), and gettimeofday everywhere else.
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#if defined(__x86_64__) || defined(__aarch64__)
+#define USE_FCYC   1   /* cycle counter (x86-64 & ARMv8) */
+#define USE_ITIMER 0   /* interval timer (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#else
+#define USE_FCYC   0   /* cycle counter (x86-64 & ARMv8) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
 #define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#endif
+
+/*
+ * Each trace is timed by repeated runs of the selected method. After
+ * TIMING_WARMUP untimed runs, samples are timed until the 95% confidence
+ * interval of the median is within TIMING_CI_TARGET of the median, or 
+ * until TIMING_BUDGET seconds have been spent. At least TIMING_MINRUNS
+ * and at most TIMING_MAXRUNS samples are taken. The throughput in the 
+ * performance index is computed from the median. The CI is over samples
+ * from one process, so it leaves out run-to-run noise; mdriver -r times
+ * the traces in separate processes to measure that.
+ *
+ * With the cycle counter a sample is one run. The interval timer and
+ * gettimeofday() tick too coarsely for that, so each of their samples
+ * is the mean of a batch of runs that lasts at least TIMING_ITIMER_SAMPLE
+ * or TIMING_GETTOD_SAMPLE seconds.
+ */
+#define TIMING_WARMUP     2     /* untimed warmup runs */
+#define TIMING_MINRUNS    7     /* fewest timed runs */
+#define TIMING_MAXRUNS    64    /* most timed runs */
+#define TIMING_BUDGET     2.0   /* secs spent timing one trace */
+#define TIMING_CI_TARGET  0.01  /* CI half-width, as a fraction of median */
+#define TIMING_ITIMER_SAMPLE 0.1    /* secs per sample; 10 ms ticks */
+#define TIMING_GETTOD_SAMPLE 0.001  /* secs per sample; 1 us ticks */
+
+/*
+ * Timings vary far more from one process to the next than within one,
+ * so mdriver -r <n> times the traces in n processes (at most 
+ * TIMING_MAXPROCS), one after the other, and keeps each one's median.
+ */
+#define TIMING_MAXPROCS 16
+
+/*
+ * When comparing against a baseline (mdriver --compare), a trace has
+ * regressed if its utilization dropped by more than COMPARE_UTIL_DROP,
+ * or if its per-process medians (-r) are slower at significance level
+ * COMPARE_ALPHA by more than COMPARE_MIN_SLOWDOWN and by more than the
+ * baseline's own medians spread (as fractions of throughput). Throughput
+ * is only compared if both sides have at least COMPARE_MIN_RUNS medians.
+ */
+#define COMPARE_ALPHA        0.05
+#define COMPARE_MIN_SLOWDOWN 0.01
+#define COMPARE_UTIL_DROP    0.001
+#define COMPARE_MIN_RUNS     4
+
+/*
+ * With mdriver -s, the state of the heap is sampled every SERIES_INTERVAL
+ * requests (change it with -S), and after every request that grows it.
+ */
+#define SERIES_INTERVAL 100
+
+/*
+ * The fragmentation breakdown sorts the free bytes at a trace's peak by
+ * the size of the block they are in. Bucket i holds blocks smaller than
+ * FRAG_BUCKET_LIMITS[i]; the last bucket holds everything larger.
+ */
+#define FRAG_BUCKETS 8
+#define FRAG_BUCKET_LIMITS {32, 64, 128, 256, 1024, 4096, 16384, 0}
+
+/*
+ * mdriver -G times the traces with mm's guarded sampling at each of 
+ * these rates (one allocation in GUARD_RATES[i] guarded), against the
+ * time with it off, in GUARD_ROUNDS rounds (at most TIMING_MAXRUNS).
+ */
+#define GUARD_RATES {10000, 1000, 100, 10}
+#define GUARD_ROUNDS 21
+
+/*
+ * mdriver -B times COPY_MOVES reallocs of a block of each of COPY_SIZES
+ * bytes (two of the largest must fit in MAX_HEAP) with each copy engine,
+ * and what reading COPY_WORKING_SET bytes after each move costs.
+ */
+#define COPY_SIZES {16 << 10, 256 << 10, 1 << 20, 8 << 20}
+#define COPY_MOVES 16
+#define COPY_WORKING_SET (256 << 10)
+
+/*
+ * mdriver -k times each walk through the live blocks CHASE_RUNS times,
+ * each after reading CHASE_EVICT times the size of the last level cache
+ * to evict them from it, and takes the median.
+ */
+#define CHASE_RUNS 11
+#define CHASE_EVICT 2
 
 #endif /* __CONFIG_H */
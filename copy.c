@@ -0,0 +1,213 @@
+/*
+ * copy.c - The copy engine mm_realloc moves payloads with. A block too
+ *     big for the cache gains nothing from passing through it: a plain
+ *     memcpy of it evicts the caller's working set to make room for data
+ *     that will be gone again before anyone reads it, and reads each line
+ *     of the destination before overwriting it. So copies bigger than the
+ *     threshold are written with non-temporal (streaming) stores, which
+ *     go around the cache to memory. When both ranges are page aligned
+ *     the copy goes a page at a time, prefetching the next source page
+ *     while the current one streams out. Smaller copies use memcpy, which
+ *     is much faster while the data fits in the cache.
+ *
+ *     Streaming only wins once a copy is bigger than the cache it would
+ *     pass through; below that, memcpy is several times faster (mdriver
+ *     -B). The threshold is this core's share of the last level cache,
+ *     as in glibc's memcpy, but at most half of MAX_HEAP so that copies
+ *     the heap can actually hold are ever streamed.
+ *     The engine is picked by CPU feature detection the first time a big
+ *     copy is made, unless copy_select picked one before. On CPUs other
+ *     than x86 every copy is a memcpy.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COPY_X86
+#endif
+#include "copy.h"
+#include "config.h"
+
+const char *copy_names[COPY_ENGINES] = { "memcpy", "sse2", "avx" };
+
+/* Streams len bytes (a multiple of 64) from s to the 64-byte aligned d */
+typedef void (*stream_funct)(char *d, const char *s, size_t len);
+
+static int engine = -1;          /* COPY_xxx in use, or -1 until picked */
+static stream_funct stream;      /* ... and its stream function */
+static size_t threshold = (size_t)-1; /* smallest copy that is streamed */
+static size_t page;              /* page size */
+
+static size_t default_threshold(void);
+
+#ifdef COPY_X86
+static void stream_sse2(char *d, const char *s, size_t len);
+static void stream_avx(char *d, const char *s, size_t len);
+#endif
+
+/*
+ * copy_supported - Returns 1 if this CPU can run engine, else 0
+ */
+int copy_supported(int engine)
+{
+#ifdef COPY_X86
+    __builtin_cpu_init();
+    switch (engine) {
+    case COPY_MEMCPY:
+	return 1;
+    case COPY_SSE2:
+	return __builtin_cpu_supports("sse2") != 0;
+    case COPY_AVX:
+	return __builtin_cpu_supports("avx") != 0;
+    }
+    return 0;
+#else
+    return engine == COPY_MEMCPY;
+#endif
+}
+
+/*
+ * copy_select - Use engine from now on, or with COPY_AUTO the last of
+ *     the engines that the CPU supports, with threshold t
+ */
+int copy_select(int e, size_t t)
+{
+    if (e == COPY_AUTO) {
+	for (e = COPY_ENGINES - 1; !copy_supported(e); e--)
+	    ;
+    }
+    else if (e < 0 || e >= COPY_ENGINES || !copy_supported(e))
+	return -1;
+    page = sysconf(_SC_PAGESIZE);
+    threshold = t > 0 ? t : default_threshold();
+    switch (e) {
+#ifdef COPY_X86
+    case COPY_SSE2:
+	stream = stream_sse2;
+	break;
+    case COPY_AVX:
+	stream = stream_avx;
+	break;
+#endif
+    default:
+	stream = NULL;
+    }
+    engine = e;
+    return e;
+}
+
+/*
+ * copy_threshold - The smallest copy that is streamed
+ */
+size_t copy_threshold(void)
+{
+    if (engine < 0)
+	copy_select(COPY_AUTO, 0);
+    return threshold;
+}
+
+/*
+ * copy_move - Copy n bytes from src to dst with the engine in use
+ */
+void *copy_move(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head, k;
+
+    if (engine < 0)
+	copy_select(COPY_AUTO, 0);
+    if (n < threshold || n < 64 || stream == NULL)
+	return memcpy(dst, src, n);
+
+    if ((((uintptr_t)d | (uintptr_t)s) & (page - 1)) == 0) {
+	/* Whole pages, with the next one on its way in */
+	for (; n >= page; d += page, s += page, n -= page) {
+	    if (n >= 2 * page) {
+		for (k = 0; k < page; k += 64)
+		    __builtin_prefetch(s + page + k, 0, 0);
+	    }
+	    stream(d, s, page);
+	}
+    }
+    else {
+	/* Up to the first cache line of dst, then whole lines */
+	head = -(uintptr_t)d & 63;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+	k = n & ~(size_t)63;
+	stream(d, s, k);
+	d += k;
+	s += k;
+	n -= k;
+    }
+    memcpy(d, s, n);
+    return dst;
+}
+
+/*
+ * default_threshold - The last level cache divided among the online 
+ *     CPUs, or COPY_NT_MIN if the system won't say how big it is; 
+ *     capped at MAX_HEAP/2
+ */
+static size_t default_threshold(void)
+{
+    long bytes = -1, cpus;
+    size_t share = COPY_NT_MIN;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if ((bytes = sysconf(_SC_LEVEL3_CACHE_SIZE)) <= 0)
+	bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (bytes > 0) {
+	if ((cpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+	    cpus = 1;
+	share = (size_t)(bytes / cpus);
+    }
+    return share < MAX_HEAP / 2 ? share : MAX_HEAP / 2;
+}
+
+#ifdef COPY_X86
+/*
+ * stream_sse2 - A cache line at a time in 16-byte streaming stores
+ */
+static void stream_sse2(char *d, const char *s, size_t len)
+{
+    __m128i a, b, c, e;
+    size_t i;
+
+    for (i = 0; i < len; i += 64) {
+	a = _mm_loadu_si128((const __m128i *)(s + i));
+	b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+	c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+	e = _mm_loadu_si128((const __m128i *)(s + i + 48));
+	_mm_stream_si128((__m128i *)(d + i), a);
+	_mm_stream_si128((__m128i *)(d + i + 16), b);
+	_mm_stream_si128((__m128i *)(d + i + 32), c);
+	_mm_stream_si128((__m128i *)(d + i + 48), e);
+    }
+    /* Order the streaming stores before any later store */
+    _mm_sfence();
+}
+
+/*
+ * stream_avx - A cache line at a time in 32-byte streaming stores
+ */
+__attribute__((target("avx")))
+static void stream_avx(char *d, const char *s, size_t len)
+{
+    __m256i a, b;
+    size_t i;
+
+    for (i = 0; i < len; i += 64) {
+	a = _mm256_loadu_si256((const __m256i *)(s + i));
+	b = _mm256_loadu_si256((const __m256i *)(s + i + 32));
+	_mm256_stream_si256((__m256i *)(d + i), a);
+	_mm256_stream_si256((__m256i *)(d + i + 32), b);
+    }
+    _mm_sfence();
+}
+#endif
@@ -0,0 +1,39 @@
+/*
+ * copy.h - prototypes for the copy engine in copy.c, which moves payloads
+ *     for mm_realloc. Copies bigger than the threshold bypass the cache
+ *     with non-temporal stores; smaller ones are left to memcpy.
+ */
+#include <stddef.h>
+
+/* The threshold if the size of the last level cache can't be found.
+   Build with e.g. -DCOPY_NT_MIN=65536 to change it. */
+#ifndef COPY_NT_MIN
+#define COPY_NT_MIN (4 << 20)
+#endif
+
+/* The engines, in order of preference */
+enum {
+    COPY_MEMCPY,   /* memcpy alone */
+    COPY_SSE2,     /* 16-byte non-temporal stores */
+    COPY_AVX,      /* 32-byte non-temporal stores */
+    COPY_ENGINES
+};
+#define COPY_AUTO -1  /* the best engine this CPU supports */
+
+/* Engine names, for reports */
+extern const char *copy_names[COPY_ENGINES];
+
+/* Does this CPU support engine? */
+int copy_supported(int engine);
+
+/* Use engine (or COPY_AUTO) from now on, streaming copies of threshold
+   bytes or more (0 for the default, this CPU's share of the last level
+   cache, at most MAX_HEAP/2). Returns
+   the engine, or -1 if the CPU doesn't support it. */
+int copy_select(int engine, size_t threshold);
+
+/* The threshold in use */
+size_t copy_threshold(void);
+
+/* Copy n bytes from src to dst, which don't overlap. Returns dst. */
+void *copy_move(void *dst, const void *src, size_t n);
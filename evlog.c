@@ -0,0 +1,237 @@
+/*
+ * evlog.c - An always-on flight recorder for the allocator. Each thread
+ *     logs its requests into a ring buffer of its own, overwriting the
+ *     oldest records once the ring is full, so that after an incident
+ *     the last EVLOG_SIZE requests of every thread are still there.
+ *     Logging a request stores one 32-byte record and bumps the ring's
+ *     head; it takes no lock and shares no cache line with other threads.
+ *
+ *     The rings are mapped from the system, never taken from the heap
+ *     being logged, and pages are only touched as records land on them.
+ *     They are written out as a binary trace (see evlog.h), merging the
+ *     threads' records by time stamp, with write() alone, so a dump can
+ *     be taken from a signal handler or while the process is crashing.
+ *
+ *     Threads beyond the first EVLOG_RINGS share the last ring, which is
+ *     only safe because mm.c logs with its heap lock held.
+ */
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "clock.h"
+#include "evlog.h"
+
+#define OUTRECS 64  /* records evlog_write buffers between write()s */
+
+/* One thread's ring of records */
+typedef struct {
+    uint64_t head;           /* records ever logged; the next goes at
+				head % EVLOG_SIZE */
+    evtrace_rec_t *recs;     /* EVLOG_SIZE records, mmap'd on first use */
+} __attribute__((aligned(64))) ring_t;
+
+static ring_t rings[EVLOG_RINGS];
+static int num_rings;              /* rings handed out since evlog_clear */
+static unsigned gen = 1;           /* bumped by evlog_clear */
+static __thread ring_t *my_ring;   /* the calling thread's ring... */
+static __thread unsigned my_gen;   /* ... and the gen it was handed out in */
+static char signal_path[256];      /* where the signal handler writes */
+static char crash_path[256];       /* where the crash handler writes */
+
+static ring_t *claim_ring(void);
+static void on_signal(int sig);
+static void on_crash(int sig);
+static void write_to(const char *path);
+
+/*
+ * evlog_clear - Drop all records. Threads are handed rings afresh, in
+ *     the order they next log a request.
+ */
+void evlog_clear(void)
+{
+    int i;
+
+    for (i = 0; i < num_rings; i++)
+	rings[i].head = 0;
+    num_rings = 0;
+    gen++;
+}
+
+/*
+ * evlog_add - Log a request in the calling thread's ring. ptr is the
+ *     block returned (or freed), old the block passed to realloc.
+ */
+void evlog_add(int op, void *ptr, void *old, unsigned long size)
+{
+    ring_t *r = my_ring;
+    evtrace_rec_t *rec;
+    uint64_t h;
+
+    if (r == NULL || my_gen != gen) {
+	if ((r = claim_ring()) == NULL)
+	    return;
+    }
+    h = r->head;
+    rec = &r->recs[h & (EVLOG_SIZE - 1)];
+    rec->ticks = read_ticks();
+    rec->ptr = (uintptr_t)ptr;
+    rec->old = (uintptr_t)old;
+    rec->size = (uint32_t)size;
+    rec->op = (uint16_t)op;
+    rec->tid = (uint16_t)(r - rings);
+    /* Publish the record before a dump can see the new head */
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * evlog_write - Write every ring's records to fd as one binary trace,
+ *     merged into time stamp order. Records logged while the dump is
+ *     being written are left out. Returns 0, or -1 if a write failed.
+ */
+int evlog_write(int fd)
+{
+    evtrace_hdr_t hdr;
+    evtrace_rec_t buf[OUTRECS];
+    uint64_t next[EVLOG_RINGS], end[EVLOG_RINGS];
+    int i, best, len = 0, n = num_rings;
+    int ok = 0;
+
+    /* Each ring holds its last EVLOG_SIZE records at most */
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EVTRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = EVTRACE_VERSION;
+    hdr.num_threads = n;
+    for (i = 0; i < n; i++) {
+	end[i] = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+	next[i] = end[i] > EVLOG_SIZE ? end[i] - EVLOG_SIZE : 0;
+	hdr.num_records += end[i] - next[i];
+    }
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+	return -1;
+
+    /* Merge the rings, taking the earliest remaining record each time */
+    for (;;) {
+	best = -1;
+	for (i = 0; i < n; i++) {
+	    if (next[i] < end[i] &&
+		(best < 0 ||
+		 rings[i].recs[next[i] & (EVLOG_SIZE - 1)].ticks <
+		 rings[best].recs[next[best] & (EVLOG_SIZE - 1)].ticks))
+		best = i;
+	}
+	if (best < 0)
+	    break;
+	buf[len++] = rings[best].recs[next[best]++ & (EVLOG_SIZE - 1)];
+	if (len == OUTRECS) {
+	    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+		ok = -1;
+	    len = 0;
+	}
+    }
+    if (len > 0 && write(fd, buf, len * sizeof(buf[0])) !=
+	len * sizeof(buf[0]))
+	ok = -1;
+    return ok;
+}
+
+/*
+ * evlog_on_signal - Write the records to path (replacing it) each time
+ *     signal sig arrives. Returns 0, or -1 if it can't be set up.
+ */
+int evlog_on_signal(int sig, const char *path)
+{
+    struct sigaction sa;
+
+    if (strlen(path) >= sizeof(signal_path))
+	return -1;
+    strcpy(signal_path, path);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(sig, &sa, NULL);
+}
+
+/*
+ * evlog_on_crash - Write the records to path if the process is killed
+ *     by SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT, then let the signal
+ *     take its course. Returns 0, or -1 if it can't be set up.
+ */
+int evlog_on_crash(const char *path)
+{
+    static const int sigs[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    struct sigaction sa;
+    int i;
+
+    if (strlen(path) >= sizeof(crash_path))
+	return -1;
+    strcpy(crash_path, path);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_crash;
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+	if (sigaction(sigs[i], &sa, NULL) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+/*
+ * claim_ring - Hand the calling thread a ring, mapping it the first time
+ *     it is used. Returns NULL if the memory can't be had.
+ */
+static ring_t *claim_ring(void)
+{
+    int i = num_rings < EVLOG_RINGS ? num_rings++ : EVLOG_RINGS - 1;
+    ring_t *r = &rings[i];
+    void *p;
+
+    if (r->recs == NULL) {
+	p = mmap(NULL, EVLOG_SIZE * sizeof(evtrace_rec_t),
+		 PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+	    return NULL;
+	r->recs = p;
+    }
+    my_ring = r;
+    my_gen = gen;
+    return r;
+}
+
+/*
+ * on_signal - Signal handler that writes the records
+ */
+static void on_signal(int sig)
+{
+    write_to(signal_path);
+}
+
+/*
+ * on_crash - Handler for fatal signals: write the records, then raise
+ *     the signal again, which now has its default action
+ */
+static void on_crash(int sig)
+{
+    write_to(crash_path);
+    raise(sig);
+}
+
+/*
+ * write_to - Write the records to path, replacing it, from a handler
+ */
+static void write_to(const char *path)
+{
+    int fd, saved_errno = errno;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+	evlog_write(fd);
+	close(fd);
+    }
+    errno = saved_errno;
+}
@@ -0,0 +1,55 @@
+/*
+ * evlog.h - The allocator event log in evlog.c, and the binary trace
+ *     format it is written in. mm.c logs every request into a ring
+ *     buffer of its thread; a dump of the rings is a binary trace that
+ *     mdriver replays like a .rep file.
+ *
+ *     A binary trace is an evtrace_hdr_t followed by num_records
+ *     evtrace_rec_t records in the order the requests were made. All
+ *     fields are in the byte order of the machine that wrote them.
+ */
+#include <stdint.h>
+
+#ifndef EVLOG_BITS
+#define EVLOG_BITS   20            /* log2 of the records kept per thread */
+#endif
+#define EVLOG_SIZE   (1 << EVLOG_BITS)
+#define EVLOG_RINGS  64            /* threads with a ring of their own */
+
+#define EVTRACE_MAGIC   "MMEV"
+#define EVTRACE_VERSION 1
+
+/* Requests, as logged in evtrace_rec_t.op */
+enum { EV_MALLOC = 1, EV_FREE, EV_REALLOC };
+
+typedef struct {
+    char magic[4];           /* EVTRACE_MAGIC, not NUL terminated */
+    uint32_t version;        /* EVTRACE_VERSION */
+    uint32_t num_threads;    /* threads that logged records */
+    uint32_t pad;
+    uint64_t num_records;    /* records that follow */
+} evtrace_hdr_t;
+
+typedef struct {
+    uint64_t ticks;          /* read_ticks() when the request returned */
+    uint64_t ptr;            /* block returned (malloc/realloc) or freed */
+    uint64_t old;            /* block passed to realloc, else 0 */
+    uint32_t size;           /* bytes requested (malloc/realloc) */
+    uint16_t op;             /* EV_MALLOC, EV_FREE or EV_REALLOC */
+    uint16_t tid;            /* logging thread, numbered from 0 */
+} evtrace_rec_t;
+
+/* Drop all records, e.g. for a new heap */
+void evlog_clear(void);
+
+/* Log a request in the calling thread's ring */
+void evlog_add(int op, void *ptr, void *old, unsigned long size);
+
+/* Write the records as a binary trace to fd, using only write() */
+int evlog_write(int fd);
+
+/* Write the records to path whenever signal sig arrives */
+int evlog_on_signal(int sig, const char *path);
+
+/* Write the records to path if the process crashes */
+int evlog_on_crash(const char *path);
@@ -168,6 +168,30 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * fcyc_once - Measure a single run of f, clearing the cache and 
+ *     compensating for timer interrupts first if so configured. Used
+ *     by callers that do their own statistics over many runs.
+ */
+double fcyc_once(test_funct f, void *argp)
+{
+    double cyc;
+
+    if (clear_cache)
+	clear();
+    if (compensate) {
+	start_comp_counter();
+	f(argp);
+	cyc = get_comp_counter();
+    } else {
+	start_counter();
+	f(argp);
+	cyc = get_counter();
+    }
+    return cyc;
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
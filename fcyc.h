@@ -13,6 +13,9 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Compute number of cycles used by a single run of test function f */
+double fcyc_once(test_funct f, void* argp);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -2,10 +2,15 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "sysenv.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
@@ -23,12 +28,11 @@ void init_fsecs(void)
     if (verbose)
 	printf("Measuring performance with a cycle counter.\n");
 
-    /* set key parameters for the fcyc package */
-    set_fcyc_maxsamples(20); 
+    /* set key parameters for fcyc_once (fsecs_stats does the rest) */
     set_fcyc_clear_cache(1);
+    set_fcyc_cache_size((int)sysenv_llc_size()); /* flush the LLC... */
+    set_fcyc_cache_block(64);    /* ... one 64-byte line at a time */
     set_fcyc_compensate(1);
-    set_fcyc_epsilon(0.01);
-    set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
 #elif USE_ITIMER
     if (verbose)
@@ -40,18 +44,133 @@ void init_fsecs(void)
 }
 
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * time_batch - Return the mean running time of n runs of f (in seconds).
+ *     The cycle counter only ever times one run.
  */
-double fsecs(fsecs_test_funct f, void *argp) 
+static double time_batch(fsecs_test_funct f, void *argp, int n)
 {
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    return fcyc_once(f, argp)/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    return ftimer_itimer(f, argp, n);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    return ftimer_gettod(f, argp, n);
 #endif 
 }
 
+/*
+ * batch_size - Return how many runs of f each sample must time for the
+ *     sample to span enough clock ticks. This is 1 with the cycle 
+ *     counter; otherwise the batch is doubled until it lasts long enough.
+ */
+static int batch_size(fsecs_test_funct f, void *argp)
+{
+    int n = 1;
+#if USE_ITIMER
+    double min_sample = TIMING_ITIMER_SAMPLE;
+#elif USE_GETTOD
+    double min_sample = TIMING_GETTOD_SAMPLE;
+#endif
+
+#if !USE_FCYC
+    while (n < (1 << 20) && time_batch(f, argp, n) * n < min_sample)
+	n *= 2;
+#endif
+    return n;
+}
+
+/*
+ * cmp_double - qsort comparison function for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * median - Return the median of the n values in sorted[]
+ */
+static double median(double *sorted, int n)
+{
+    return (n % 2) ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2]) / 2;
+}
+
+/*
+ * fsecs_summarize - Compute the median, MAD, and a distribution-free 95% 
+ *     confidence interval for the median of the stats->runs samples. The
+ *     CI is bounded by the order statistics at ranks n/2 -+ 1.96*sqrt(n)/2.
+ *     The samples all come from one process, so the CI covers only the
+ *     noise within that process, not the run-to-run noise (heap layout,
+ *     page placement, frequency) that separate processes see.
+ */
+void fsecs_summarize(fsecs_stats_t *stats)
+{
+    int i, lo, hi, n = stats->runs;
+    double sorted[TIMING_MAXRUNS];
+    double dev[TIMING_MAXRUNS];
+    double half = 1.96 * sqrt((double)n) / 2;
+
+    memcpy(sorted, stats->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    stats->median = median(sorted, n);
+    for (i = 0; i < n; i++)
+	dev[i] = fabs(sorted[i] - stats->median);
+    qsort(dev, n, sizeof(double), cmp_double);
+    stats->mad = median(dev, n);
+
+    lo = (int)floor(n/2.0 - half);      /* 1-based ranks */
+    hi = (int)ceil(1 + n/2.0 + half);
+    lo = (lo < 1) ? 1 : lo;
+    hi = (hi > n) ? n : hi;
+    stats->ci_lo = sorted[lo-1];
+    stats->ci_hi = sorted[hi-1];
+}
+
+/*
+ * fsecs_stats - Time f repeatedly and summarize the samples in *stats
+ *     (if not NULL). Returns the median running time of f (in seconds).
+ *     See config.h for the warmup, budget, and confidence settings.
+ */
+double fsecs_stats(fsecs_test_funct f, void *argp, fsecs_stats_t *stats)
+{
+    int i, batch;
+    double spent = 0;
+    fsecs_stats_t local;
+
+    if (stats == NULL)
+	stats = &local;
+    memset(stats, 0, sizeof(fsecs_stats_t));
+
+    /* Warm up the caches, branch predictors, and page tables */
+    for (i = 0; i < TIMING_WARMUP; i++)
+	f(argp);
+
+    /* Time samples until the median is known well enough */
+    batch = batch_size(f, argp);
+    while (stats->runs < TIMING_MAXRUNS) {
+	stats->samples[stats->runs] = time_batch(f, argp, batch);
+	spent += stats->samples[stats->runs] * batch;
+	stats->runs++;
+	if (stats->runs < TIMING_MINRUNS)
+	    continue;
+	fsecs_summarize(stats);
+	if ((stats->ci_hi - stats->ci_lo) / 2 <= 
+	    TIMING_CI_TARGET * stats->median || spent >= TIMING_BUDGET)
+	    break;
+    }
+    fsecs_summarize(stats);
+    return stats->median;
+}
+
+/*
+ * fsecs - Return the median running time of a function f (in seconds)
+ */
+double fsecs(fsecs_test_funct f, void *argp) 
+{
+    return fsecs_stats(f, argp, NULL);
+}
+
 
@@ -1,4 +1,17 @@
+#include "config.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
+/* Summary of the timed runs of a function (all times in seconds) */
+typedef struct {
+    int runs;                        /* number of timed samples */
+    double median;                   /* median run time */
+    double mad;                      /* median absolute deviation */
+    double ci_lo, ci_hi;             /* within-process 95% CI of median */
+    double samples[TIMING_MAXRUNS];  /* mean run time in each sample */
+} fsecs_stats_t;
+
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_stats(fsecs_test_funct f, void *argp, fsecs_stats_t *stats);
+void fsecs_summarize(fsecs_stats_t *stats);
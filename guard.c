@@ -0,0 +1,280 @@
+/*
+ * guard.c - A guarded pool in the style of GWP-ASan, for catching heap
+ *     overflows and uses after free in production at a cost too low to
+ *     notice. The allocator sends about one allocation in `rate' here;
+ *     the rest never see the pool beyond a range check on free.
+ *
+ *     The pool is one mapping of GUARD_SLOTS data pages, each between
+ *     two guard pages that are never accessible. A sampled block is put
+ *     at the end of a data page, so running off its end faults on the
+ *     next guard page (the few bytes of alignment slack are filled with
+ *     a pattern and checked on free). Freeing the block makes its data
+ *     page inaccessible, and freed slots are reused oldest first, so a
+ *     late use after free still faults. A SIGSEGV/SIGBUS handler turns
+ *     faults in the pool into a report on stderr, then hands the signal
+ *     on to whatever handled it before.
+ *
+ *     The caller serializes all calls except the fault handler.
+ */
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "guard.h"
+
+#define GUARD_FILL 0xab  /* pattern in the slack after a block */
+
+/* States of a slot */
+enum { SLOT_UNUSED, SLOT_LIVE, SLOT_FREED };
+
+typedef struct {
+    char *ptr;        /* the block, if the slot has held one */
+    size_t size;      /* bytes asked for */
+    int state;        /* SLOT_xxx */
+} slot_t;
+
+uintptr_t guard_lo;                /* first byte of the pool */
+size_t guard_bytes;                /* bytes in the pool */
+
+static char *pool;                 /* guard_lo, as a pointer */
+static size_t page;                /* page size */
+static unsigned long rate;         /* mean allocations between samples */
+static slot_t slots[GUARD_SLOTS];
+static int queue[GUARD_SLOTS];     /* free slots, oldest freed first */
+static int queue_head, queue_len;
+static uint64_t rng = 0x9e3779b97f4a7c15ULL; /* xorshift64 state */
+static struct sigaction old_segv, old_bus;   /* handlers we displaced */
+
+static void on_fault(int sig, siginfo_t *info, void *uc);
+static int slot_of(char *p);
+static void report(const char *what, int i, char *addr);
+static int put(char *buf, int len, const char *s);
+static int put_num(char *buf, int len, unsigned long val, int base);
+
+/*
+ * guard_reset - Set the mean number of allocations between samples
+ *     (0 turns sampling off) and free every slot. Maps the pool and
+ *     installs the fault handler the first time around. Returns 0, or
+ *     -1 if the pool can't be had.
+ */
+int guard_reset(unsigned long r)
+{
+    struct sigaction sa;
+    void *p;
+
+    if (pool == NULL) {
+	page = sysconf(_SC_PAGESIZE);
+	p = mmap(NULL, (2 * GUARD_SLOTS + 1) * page, PROT_NONE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+	    return -1;
+	pool = p;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = on_fault;
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, &old_segv);
+	sigaction(SIGBUS, &sa, &old_bus);
+	guard_lo = (uintptr_t)pool;
+	guard_bytes = (2 * GUARD_SLOTS + 1) * page;
+    }
+    rate = r;
+    guard_clear();
+    return 0;
+}
+
+/*
+ * guard_clear - Free every slot, protecting the pages of live blocks
+ */
+void guard_clear(void)
+{
+    int i;
+
+    if (pool == NULL)
+	return;
+    for (i = 0; i < GUARD_SLOTS; i++) {
+	if (slots[i].state == SLOT_LIVE)
+	    mprotect(pool + (2 * i + 1) * page, page, PROT_NONE);
+	slots[i].state = SLOT_UNUSED;
+	queue[i] = i;
+    }
+    queue_head = 0;
+    queue_len = GUARD_SLOTS;
+}
+
+/*
+ * guard_next - Draw the allocations until the next sample, uniformly
+ *     from 1 to 2 * rate, so that they average about rate
+ */
+long guard_next(void)
+{
+    if (rate == 0)
+	return LONG_MAX;
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (long)(rng % (2 * rate)) + 1;
+}
+
+/*
+ * guard_alloc - Place a block of size bytes at the end of the data page
+ *     of the free slot that was freed longest ago
+ */
+void *guard_alloc(size_t size)
+{
+    char *data, *p;
+    size_t asize = (size + 7) & ~(size_t)7;
+    int i;
+
+    if (size == 0 || asize > page || queue_len == 0)
+	return NULL;
+    i = queue[queue_head];
+    data = pool + (2 * i + 1) * page;
+    if (mprotect(data, page, PROT_READ | PROT_WRITE) < 0)
+	return NULL;
+    queue_head = (queue_head + 1) % GUARD_SLOTS;
+    queue_len--;
+    p = data + page - asize;
+    memset(p + size, GUARD_FILL, asize - size);
+    slots[i].ptr = p;
+    slots[i].size = size;
+    slots[i].state = SLOT_LIVE;
+    return p;
+}
+
+/*
+ * guard_free - Free the block p, after checking that it is live and its
+ *     slack untouched. Aborts with a report if not.
+ */
+void guard_free(void *p)
+{
+    int i = slot_of(p);
+    size_t j, asize;
+
+    if (i < 0 || slots[i].state != SLOT_LIVE || slots[i].ptr != p) {
+	report(i >= 0 && slots[i].state == SLOT_FREED && slots[i].ptr == p ?
+	       "double free" : "invalid free", i, p);
+	abort();
+    }
+    asize = (slots[i].size + 7) & ~(size_t)7;
+    for (j = slots[i].size; j < asize; j++) {
+	if ((unsigned char)slots[i].ptr[j] != GUARD_FILL) {
+	    report("overflow", i, slots[i].ptr + j);
+	    abort();
+	}
+    }
+    mprotect(pool + (2 * i + 1) * page, page, PROT_NONE);
+    slots[i].state = SLOT_FREED;
+    queue[(queue_head + queue_len++) % GUARD_SLOTS] = i;
+}
+
+/*
+ * guard_size - The bytes asked for the block p
+ */
+size_t guard_size(void *p)
+{
+    int i = slot_of(p);
+
+    return i < 0 ? 0 : slots[i].size;
+}
+
+/*
+ * on_fault - SIGSEGV/SIGBUS handler. Reports a fault in the pool, then
+ *     puts back the handler it displaced and returns, so that the access
+ *     faults again into that one (or kills the process by default).
+ */
+static void on_fault(int sig, siginfo_t *info, void *uc)
+{
+    char *addr = info->si_addr;
+    size_t k;
+    int left, right;
+
+    if (info->si_code > 0 && guard_owns(addr)) {
+	k = (addr - pool) / page;
+	left = (k % 2) ? (int)(k / 2) : (int)(k / 2) - 1;
+	right = (k % 2) ? (int)(k / 2) : (int)(k / 2);
+	if (k % 2 && slots[left].state == SLOT_FREED)
+	    report("use after free", left, addr);
+	else if (k % 2)
+	    report("wild access", -1, addr);
+	else if (left >= 0 && slots[left].state == SLOT_LIVE)
+	    report("overflow", left, addr);
+	else if (right < GUARD_SLOTS && slots[right].state == SLOT_LIVE)
+	    report("underflow", right, addr);
+	else
+	    report("wild access", -1, addr);
+    }
+    sigaction(sig, sig == SIGBUS ? &old_bus : &old_segv, NULL);
+    if (info->si_code <= 0)
+	raise(sig);
+}
+
+/*
+ * slot_of - The slot whose data page holds p, or -1 if none does
+ */
+static int slot_of(char *p)
+{
+    size_t k;
+
+    if (!guard_owns(p))
+	return -1;
+    k = (p - pool) / page;
+    return (k % 2) ? (int)(k / 2) : -1;
+}
+
+/*
+ * report - Describe a memory error found at addr, in or near slot i
+ *     (-1 if none), on stderr. Uses write() alone.
+ */
+static void report(const char *what, int i, char *addr)
+{
+    char buf[256];
+    int len = 0;
+
+    len = put(buf, len, "guard: ");
+    len = put(buf, len, what);
+    if (i >= 0) {
+	len = put(buf, len, " of the block at 0x");
+	len = put_num(buf, len, (uintptr_t)slots[i].ptr, 16);
+	len = put(buf, len, " (size ");
+	len = put_num(buf, len, slots[i].size, 10);
+	len = put(buf, len, ")");
+    }
+    else
+	len = put(buf, len, " in the guarded pool");
+    len = put(buf, len, ", at 0x");
+    len = put_num(buf, len, (uintptr_t)addr, 16);
+    len = put(buf, len, "\n");
+    if (write(STDERR_FILENO, buf, len) != len)
+	return;
+}
+
+/*
+ * put - Append s to buf, which holds len bytes. Returns the new length.
+ */
+static int put(char *buf, int len, const char *s)
+{
+    int n = strlen(s);
+
+    memcpy(buf + len, s, n);
+    return len + n;
+}
+
+/*
+ * put_num - Append val, in base 10 or 16, to buf with put()
+ */
+static int put_num(char *buf, int len, unsigned long val, int base)
+{
+    char digits[24];
+    int i = sizeof(digits) - 1;
+
+    digits[i] = '\0';
+    do {
+	digits[--i] = "0123456789abcdef"[val % base];
+	val /= base;
+    } while (val > 0);
+    return put(buf, len, digits + i);
+}
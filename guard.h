@@ -0,0 +1,36 @@
+/*
+ * guard.h - prototypes for the guarded pool in guard.c. mm.c decides
+ *     which allocations to sample; guard.c gives each one a page of its
+ *     own between inaccessible guard pages, and reports the faults that
+ *     overflows and uses after free take there.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define GUARD_SLOTS 256  /* most guarded blocks live at once */
+
+/* The pool's address range, for guard_owns; empty until guard_reset */
+extern uintptr_t guard_lo;
+extern size_t guard_bytes;
+
+/* Is p a block from the pool? One subtraction and compare. */
+#define guard_owns(p) ((uintptr_t)(p) - guard_lo < guard_bytes)
+
+/* Set the mean allocations between samples (0 for none), free all slots */
+int guard_reset(unsigned long rate);
+
+/* Free all slots but keep the rate (e.g. for a new heap) */
+void guard_clear(void);
+
+/* Draw the number of allocations until the next sample */
+long guard_next(void);
+
+/* Place a block of size bytes in the pool; NULL if it is full or size
+   is more than a page */
+void *guard_alloc(size_t size);
+
+/* Free a block from the pool, protecting its page */
+void guard_free(void *p);
+
+/* The number of bytes asked for the block p from the pool */
+size_t guard_size(void *p);
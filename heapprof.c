@@ -0,0 +1,289 @@
+/*
+ * heapprof.c - A sampling heap profiler in the style of tcmalloc's. The
+ *     allocator counts down the bytes it hands out and, when the count
+ *     runs out, records the allocation and its call stack here. The 
+ *     countdowns are drawn from an exponential distribution, so that on
+ *     average one sample is taken every `interval' bytes and every byte
+ *     is equally likely to be sampled. Each sample is weighted by the 
+ *     number of bytes it stands for, which makes the sum of the weights
+ *     of the live samples an unbiased estimate of the live heap.
+ *
+ *     Samples live in an open-addressing hash table in memory mapped 
+ *     from the system, never in the heap being profiled. Profiles are 
+ *     written with write() alone, so they can be written from a signal
+ *     handler. The caller serializes all calls except the signal-time 
+ *     write, which is best effort.
+ */
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include "heapprof.h"
+
+#define OUTBUF 512  /* bytes heapprof_write buffers between write()s */
+
+/* One sampled allocation that is still live */
+typedef struct {
+    void *ptr;                    /* the block, or NULL if slot is empty */
+    unsigned long size;           /* bytes requested */
+    double weight;                /* bytes of allocation it stands for */
+    int depth;                    /* number of frames in its stack */
+    void *frames[HEAPPROF_DEPTH]; /* return addresses, innermost first */
+} sample_t;
+
+static sample_t *table;            /* HEAPPROF_SLOTS slots, mmap'd */
+static unsigned long interval;     /* mean bytes between samples */
+static int live_samples;           /* occupied slots */
+static unsigned long dropped;      /* samples lost to a full table */
+static uint64_t rng = 0x9e3779b97f4a7c15ULL; /* xorshift64 state */
+static char signal_path[256];      /* where the signal handler writes */
+
+static unsigned long slot_of(void *p);
+static void on_signal(int sig);
+static int put(int fd, char *buf, int *len, const char *s);
+static int put_num(int fd, char *buf, int *len, unsigned long val, int base);
+
+/*
+ * heapprof_reset - Set the mean sampling interval (0 turns sampling off)
+ *     and drop all samples. Maps the table the first time around.
+ */
+void heapprof_reset(unsigned long bytes)
+{
+    void *frames[1];
+
+    if (table == NULL) {
+	table = mmap(NULL, HEAPPROF_SLOTS * sizeof(sample_t), 
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 
+		     -1, 0);
+	if (table == MAP_FAILED) {
+	    table = NULL;
+	    bytes = 0;
+	}
+	/* backtrace() loads its unwinder on first use; do it now */
+	backtrace(frames, 1);
+    }
+    interval = bytes;
+    heapprof_clear();
+}
+
+/*
+ * heapprof_clear - Drop all samples but keep the interval
+ */
+void heapprof_clear(void)
+{
+    if (table != NULL && live_samples > 0)
+	memset(table, 0, HEAPPROF_SLOTS * sizeof(sample_t));
+    live_samples = 0;
+    dropped = 0;
+}
+
+/*
+ * heapprof_next - Draw the number of bytes to allocate before the next
+ *     sample from an exponential distribution with mean interval
+ */
+long heapprof_next(void)
+{
+    double u;
+
+    if (interval == 0)
+	return LONG_MAX;
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    u = ((rng >> 11) + 1.0) / 9007199254740993.0;  /* (0, 1] */
+    return (long)(-log(u) * interval) + 1;
+}
+
+/*
+ * heapprof_record - Record a sampled allocation of size bytes at p. 
+ *     An allocation of size s is sampled with probability about 
+ *     1 - exp(-s/interval), so it stands for s divided by that.
+ */
+void heapprof_record(void *p, unsigned long size)
+{
+    unsigned long i;
+    sample_t *s;
+
+    if (table == NULL || interval == 0)
+	return;
+    if (live_samples >= HEAPPROF_SLOTS - 1) {
+	dropped++;
+	return;
+    }
+    for (i = slot_of(p); table[i].ptr != NULL; i = (i + 1) % HEAPPROF_SLOTS)
+	;
+    s = &table[i];
+    s->ptr = p;
+    s->size = size;
+    s->weight = size / (1.0 - exp(-(double)size / interval));
+    s->depth = backtrace(s->frames, HEAPPROF_DEPTH);
+    live_samples++;
+}
+
+/*
+ * heapprof_forget - Forget the sample at p. Removal shifts later members
+ *     of the probe run back, so that lookups never need tombstones.
+ */
+void heapprof_forget(void *p)
+{
+    unsigned long i, j, home;
+
+    if (table == NULL)
+	return;
+    for (i = slot_of(p); table[i].ptr != p; i = (i + 1) % HEAPPROF_SLOTS)
+	if (table[i].ptr == NULL)
+	    return;  /* not sampled */
+
+    for (j = (i + 1) % HEAPPROF_SLOTS; table[j].ptr != NULL; 
+	 j = (j + 1) % HEAPPROF_SLOTS) {
+	home = slot_of(table[j].ptr);
+	/* move j into the hole at i unless its home lies in (i, j] */
+	if ((j > i && (home <= i || home > j)) || 
+	    (j < i && (home <= i && home > j))) {
+	    table[i] = table[j];
+	    i = j;
+	}
+    }
+    table[i].ptr = NULL;
+    live_samples--;
+}
+
+/*
+ * heapprof_live - Estimate the live heap bytes from the samples
+ */
+double heapprof_live(void)
+{
+    unsigned long i;
+    double bytes = 0;
+
+    if (table == NULL || live_samples == 0)
+	return 0;
+    for (i = 0; i < HEAPPROF_SLOTS; i++)
+	if (table[i].ptr != NULL)
+	    bytes += table[i].weight;
+    return bytes;
+}
+
+/*
+ * heapprof_write - Write a heap profile to fd: a header line, then one
+ *     line per live sample giving the bytes it stands for, the bytes 
+ *     requested, and its stack as hex return addresses (symbolize them
+ *     with addr2line). Uses no stdio, so it's safe in a signal handler.
+ */
+int heapprof_write(int fd)
+{
+    char buf[OUTBUF];
+    int j, len = 0, ok = 0;
+    unsigned long i;
+
+    ok |= put(fd, buf, &len, "heap profile: ");
+    ok |= put_num(fd, buf, &len, live_samples, 10);
+    ok |= put(fd, buf, &len, " samples, ");
+    ok |= put_num(fd, buf, &len, (unsigned long)heapprof_live(), 10);
+    ok |= put(fd, buf, &len, " bytes estimated live, sampling every ");
+    ok |= put_num(fd, buf, &len, interval, 10);
+    ok |= put(fd, buf, &len, " bytes, ");
+    ok |= put_num(fd, buf, &len, dropped, 10);
+    ok |= put(fd, buf, &len, " dropped\n");
+    for (i = 0; table != NULL && i < HEAPPROF_SLOTS; i++) {
+	sample_t *s = &table[i];
+
+	if (s->ptr == NULL)
+	    continue;
+	ok |= put_num(fd, buf, &len, (unsigned long)s->weight, 10);
+	ok |= put(fd, buf, &len, " ");
+	ok |= put_num(fd, buf, &len, s->size, 10);
+	ok |= put(fd, buf, &len, ":");
+	for (j = 0; j < s->depth; j++) {
+	    ok |= put(fd, buf, &len, " 0x");
+	    ok |= put_num(fd, buf, &len, (unsigned long)s->frames[j], 16);
+	}
+	ok |= put(fd, buf, &len, "\n");
+    }
+    if (len > 0 && write(fd, buf, len) != len)
+	ok = -1;
+    return ok ? -1 : 0;
+}
+
+/*
+ * heapprof_on_signal - Write a heap profile to path (replacing it) each
+ *     time signal sig arrives. Returns 0, or -1 if it can't be set up.
+ */
+int heapprof_on_signal(int sig, const char *path)
+{
+    struct sigaction sa;
+
+    if (strlen(path) >= sizeof(signal_path))
+	return -1;
+    strcpy(signal_path, path);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(sig, &sa, NULL);
+}
+
+/*
+ * on_signal - Signal handler that writes the heap profile
+ */
+static void on_signal(int sig)
+{
+    int fd, saved_errno = errno;
+
+    fd = open(signal_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+	heapprof_write(fd);
+	close(fd);
+    }
+    errno = saved_errno;
+}
+
+/*
+ * slot_of - Hash a block address to its home slot
+ */
+static unsigned long slot_of(void *p)
+{
+    return (unsigned long)((((uintptr_t)p >> 3) * 0x9e3779b97f4a7c15ULL) >> 
+			   (64 - HEAPPROF_BITS));
+}
+
+/*
+ * put - Append s to buf, first flushing buf to fd if it would overflow.
+ *     Returns 0, or -1 if a write failed.
+ */
+static int put(int fd, char *buf, int *len, const char *s)
+{
+    int n = strlen(s);
+    int ret = 0;
+
+    if (*len + n > OUTBUF) {
+	if (write(fd, buf, *len) != *len)
+	    ret = -1;
+	*len = 0;
+    }
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return ret;
+}
+
+/*
+ * put_num - Append val, in base 10 or 16, to buf with put()
+ */
+static int put_num(int fd, char *buf, int *len, unsigned long val, int base)
+{
+    char digits[24];
+    int i = sizeof(digits) - 1;
+
+    digits[i] = '\0';
+    do {
+	digits[--i] = "0123456789abcdef"[val % base];
+	val /= base;
+    } while (val > 0);
+    return put(fd, buf, len, digits + i);
+}
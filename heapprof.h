@@ -0,0 +1,33 @@
+/*
+ * heapprof.h - prototypes for the sampling heap profiler in heapprof.c.
+ *     mm.c decides which allocations to sample; heapprof.c keeps the 
+ *     live samples and their call stacks and writes heap profiles.
+ */
+
+#define HEAPPROF_BITS   16         /* log2 of the number of table slots */
+#define HEAPPROF_SLOTS  (1 << HEAPPROF_BITS) /* most live samples kept */
+#define HEAPPROF_DEPTH  16         /* most stack frames kept per sample */
+
+/* Set the mean sampling interval in bytes, and drop all samples */
+void heapprof_reset(unsigned long interval);
+
+/* Drop all samples but keep the interval (e.g. for a new heap) */
+void heapprof_clear(void);
+
+/* Draw the number of bytes to allocate before the next sample */
+long heapprof_next(void);
+
+/* Record a sampled allocation of size bytes at p, with its call stack */
+void heapprof_record(void *p, unsigned long size);
+
+/* Forget the sample at p, which is being freed */
+void heapprof_forget(void *p);
+
+/* Estimate the live heap bytes from the samples */
+double heapprof_live(void);
+
+/* Write a heap profile to fd, using only write(). Returns 0 or -1. */
+int heapprof_write(int fd);
+
+/* Write a heap profile to path whenever signal sig arrives */
+int heapprof_on_signal(int sig, const char *path);
@@ -0,0 +1,22 @@
+/*
+ * heapsnap.h - The heap snapshot format written by mm_heap_snapshot()
+ *     and read by heapview. A snapshot is the block map of the heap at
+ *     one moment: a heapsnap_hdr_t followed by one 32-bit word per block
+ *     in address order, holding the block's size with its allocated bit
+ *     in bit 0, and ended by a zero word. Blocks are contiguous, so each
+ *     block's offset is the first block's plus the sizes before it.
+ *     All fields are in the byte order of the machine that wrote them.
+ */
+#include <stdint.h>
+
+#define HEAPSNAP_MAGIC   "MMHS"
+#define HEAPSNAP_VERSION 1
+
+typedef struct {
+    char magic[4];        /* HEAPSNAP_MAGIC, not NUL terminated */
+    uint32_t version;     /* HEAPSNAP_VERSION */
+    uint64_t heap_bytes;  /* size of the heap */
+    uint64_t first;       /* offset of the first block from the heap start */
+} heapsnap_hdr_t;
+
+#define HEAPSNAP_ALLOC   0x1  /* allocated bit of a block word */
@@ -0,0 +1,284 @@
+/*
+ * heapview.c - Renders a heap snapshot written by mm_heap_snapshot()
+ *     (see heapsnap.h) as a summary, a map of where the free bytes lie
+ *     in the heap, and a histogram of free block sizes.
+ *
+ *     The snapshot is read once, a block at a time, and only the map
+ *     cells and histogram buckets are kept, so heaps of many gigabytes
+ *     and hundreds of millions of blocks take no more memory than
+ *     small ones.
+ *
+ *     usage: heapview [-c <cols>] [-r <rows>] <snapshot>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "heapsnap.h"
+
+#define READ_WORDS  4096   /* block words read at a time */
+#define MAX_CELLS   65536  /* most cells in the map */
+#define BUCKETS     40     /* free size buckets: up to 2^i bytes */
+#define BAR_WIDTH   40     /* widest histogram bar */
+
+/* What heapview learns from one pass over a snapshot */
+typedef struct {
+    uint64_t blocks, alloc_blocks, free_blocks;
+    uint64_t alloc_bytes, free_bytes, largest_free;
+    uint64_t end;                     /* offset just past the last block */
+    uint64_t bucket_blocks[BUCKETS];  /* free blocks by size... */
+    uint64_t bucket_bytes[BUCKETS];   /* ... and the bytes in them */
+    uint64_t cell_bytes;              /* heap bytes per map cell */
+    int cells;                        /* number of map cells */
+    double *cell_free;                /* free bytes in each cell */
+} view_t;
+
+static void read_snapshot(char *path, heapsnap_hdr_t *hdr, view_t *view);
+static void add_free(view_t *view, uint64_t off, uint64_t size);
+static void print_summary(char *path, heapsnap_hdr_t *hdr, view_t *view);
+static void print_map(view_t *view, int cols);
+static void print_histogram(view_t *view);
+static void usage(void);
+static void app_error(char *msg);
+
+static char msg[1024];
+
+int main(int argc, char **argv)
+{
+    int c, cols = 64, rows = 16;
+    heapsnap_hdr_t hdr;
+    view_t view;
+
+    while ((c = getopt(argc, argv, "c:r:h")) != EOF) {
+	switch (c) {
+	case 'c': /* Map this many cells across */
+	    cols = atoi(optarg);
+	    break;
+	case 'r': /* ... and this many down */
+	    rows = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1 || cols < 1 || rows < 1 ||
+	cols * rows > MAX_CELLS) {
+	usage();
+	exit(1);
+    }
+
+    memset(&view, 0, sizeof(view));
+    view.cells = cols * rows;
+    if ((view.cell_free = calloc(view.cells, sizeof(double))) == NULL)
+	app_error("calloc failed in main");
+    read_snapshot(argv[optind], &hdr, &view);
+
+    print_summary(argv[optind], &hdr, &view);
+    printf("\nFree space map (%lu bytes per cell; '#' none free, "
+	   "'+' under half, '.' over half, ' ' all free):\n",
+	   (unsigned long)view.cell_bytes);
+    print_map(&view, cols);
+    printf("\nFree blocks by size:\n");
+    print_histogram(&view);
+    free(view.cell_free);
+    return 0;
+}
+
+/*
+ * read_snapshot - Read the snapshot at path in one pass, filling in
+ *     *hdr and *view
+ */
+static void read_snapshot(char *path, heapsnap_hdr_t *hdr, view_t *view)
+{
+    FILE *fp;
+    uint32_t words[READ_WORDS];
+    uint64_t off, size;
+    size_t i, n;
+    int b, done = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s", path);
+	app_error(msg);
+    }
+    if (fread(hdr, sizeof(*hdr), 1, fp) != 1 ||
+	memcmp(hdr->magic, HEAPSNAP_MAGIC, 4) != 0 ||
+	hdr->version != HEAPSNAP_VERSION) {
+	sprintf(msg, "%s is not a version %d heap snapshot", path,
+		HEAPSNAP_VERSION);
+	app_error(msg);
+    }
+    view->cell_bytes = (hdr->heap_bytes + view->cells - 1) / view->cells;
+    if (view->cell_bytes == 0)
+	view->cell_bytes = 1;
+
+    off = hdr->first;
+    while (!done && (n = fread(words, sizeof(uint32_t), READ_WORDS, fp)) > 0) {
+	for (i = 0; i < n; i++) {
+	    size = words[i] & ~(uint32_t)0x7;
+	    if (size == 0) {
+		done = 1;
+		break;
+	    }
+	    view->blocks++;
+	    if (words[i] & HEAPSNAP_ALLOC) {
+		view->alloc_blocks++;
+		view->alloc_bytes += size;
+	    }
+	    else {
+		view->free_blocks++;
+		view->free_bytes += size;
+		if (size > view->largest_free)
+		    view->largest_free = size;
+		for (b = 0; b < BUCKETS - 1 && ((uint64_t)1 << b) < size; b++)
+		    ;
+		view->bucket_blocks[b]++;
+		view->bucket_bytes[b] += size;
+		add_free(view, off, size);
+	    }
+	    off += size;
+	}
+    }
+    fclose(fp);
+    if (!done) {
+	sprintf(msg, "%s ends before its last block", path);
+	app_error(msg);
+    }
+    if (off > hdr->heap_bytes) {
+	sprintf(msg, "%s has blocks past the end of its heap", path);
+	app_error(msg);
+    }
+    view->end = off;
+}
+
+/*
+ * add_free - Spread the free block at off over the map cells it covers
+ */
+static void add_free(view_t *view, uint64_t off, uint64_t size)
+{
+    uint64_t end = off + size, cell_end;
+    uint64_t cell = off / view->cell_bytes;
+
+    while (off < end && cell < view->cells) {
+	cell_end = (cell + 1) * view->cell_bytes;
+	if (cell_end > end)
+	    cell_end = end;
+	view->cell_free[cell] += cell_end - off;
+	off = cell_end;
+	cell++;
+    }
+}
+
+/*
+ * print_summary - Print the block counts and how fragmented the free
+ *     space is: 0 if it is all one block, near 1 if it is in crumbs
+ */
+static void print_summary(char *path, heapsnap_hdr_t *hdr, view_t *view)
+{
+    printf("%s: %lu heap bytes in %lu blocks\n", path,
+	   (unsigned long)hdr->heap_bytes, (unsigned long)view->blocks);
+    printf("Allocated: %lu bytes in %lu blocks (%.1f%% of heap)\n",
+	   (unsigned long)view->alloc_bytes,
+	   (unsigned long)view->alloc_blocks,
+	   hdr->heap_bytes ? 100.0 * view->alloc_bytes / hdr->heap_bytes : 0);
+    printf("Free:      %lu bytes in %lu blocks (%.1f%% of heap), "
+	   "largest %lu\n",
+	   (unsigned long)view->free_bytes, (unsigned long)view->free_blocks,
+	   hdr->heap_bytes ? 100.0 * view->free_bytes / hdr->heap_bytes : 0,
+	   (unsigned long)view->largest_free);
+    printf("Fragmentation (1 - largest/free): %.3f\n",
+	   view->free_bytes ?
+	   1.0 - (double)view->largest_free / view->free_bytes : 0);
+}
+
+/*
+ * print_map - Print the map cols cells to a row, each row labelled with
+ *     the heap offset it starts at
+ */
+static void print_map(view_t *view, int cols)
+{
+    int i;
+    uint64_t start;
+    double share;
+    char c;
+
+    for (i = 0; i < view->cells; i++) {
+	start = (uint64_t)i * view->cell_bytes;
+	if (i % cols == 0)
+	    printf("%12lu |", (unsigned long)start);
+	share = view->cell_free[i] / view->cell_bytes;
+	if (start >= view->end)
+	    c = ' ';
+	else if (share == 0)
+	    c = '#';
+	else if (share < 0.5)
+	    c = '+';
+	else if (share < 1.0)
+	    c = '.';
+	else
+	    c = ' ';
+	putchar(c);
+	if (i % cols == cols - 1)
+	    printf("|\n");
+    }
+    if (view->cells % cols != 0)
+	printf("|\n");
+}
+
+/*
+ * print_histogram - Print the non-empty free size buckets, with a bar
+ *     for each one's share of the free bytes
+ */
+static void print_histogram(view_t *view)
+{
+    int b, len;
+    uint64_t max = 0;
+
+    for (b = 0; b < BUCKETS; b++) {
+	if (view->bucket_bytes[b] > max)
+	    max = view->bucket_bytes[b];
+    }
+    printf("%14s %12s %14s %6s\n", "size <=", "blocks", "bytes", "%free");
+    for (b = 0; b < BUCKETS; b++) {
+	if (view->bucket_blocks[b] == 0)
+	    continue;
+	if (b < BUCKETS - 1)
+	    printf("%14lu ", 1UL << b);
+	else
+	    printf("%14s ", "larger");
+	printf("%12lu %14lu %5.1f%% ",
+	       (unsigned long)view->bucket_blocks[b],
+	       (unsigned long)view->bucket_bytes[b],
+	       100.0 * view->bucket_bytes[b] / view->free_bytes);
+	len = (int)(BAR_WIDTH * view->bucket_bytes[b] / max);
+	while (len-- > 0)
+	    putchar('*');
+	putchar('\n');
+    }
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: heapview [-h] [-c <cols>] [-r <rows>] "
+	    "<snapshot>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c <cols>  Cells across the free space map "
+	    "(default 64).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-r <rows>  Rows in the free space map (default 16).\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
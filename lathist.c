@@ -0,0 +1,80 @@
+/*
+ * lathist.c - Log-bucketed (HDR-style) histograms for recording the
+ *     latencies of individual allocator requests. Recording a value is
+ *     a few shifts and an increment, so it can be done on every request.
+ */
+#include <string.h>
+#include "lathist.h"
+
+/* 
+ * bucket_of - Return the index of the bucket that holds val 
+ */
+static int bucket_of(unsigned long long val)
+{
+    int e;
+
+    if (val < LATHIST_SUB)
+	return (int)val;
+    e = 63 - __builtin_clzll(val);  /* position of the leading 1 bit */
+    return LATHIST_SUB + (e - LATHIST_SUBBITS) * LATHIST_SUB + 
+	(int)((val >> (e - LATHIST_SUBBITS)) - LATHIST_SUB);
+}
+
+/* 
+ * bucket_lo - Return the smallest value that falls into bucket b
+ */
+static unsigned long long bucket_lo(int b)
+{
+    int e;
+
+    if (b < LATHIST_SUB)
+	return (unsigned long long)b;
+    e = (b - LATHIST_SUB) / LATHIST_SUB + LATHIST_SUBBITS;
+    return (unsigned long long)(LATHIST_SUB + (b % LATHIST_SUB)) 
+	<< (e - LATHIST_SUBBITS);
+}
+
+/*
+ * lathist_init - Empty the histogram
+ */
+void lathist_init(lathist_t *h)
+{
+    memset(h, 0, sizeof(lathist_t));
+}
+
+/*
+ * lathist_add - Record a value
+ */
+void lathist_add(lathist_t *h, unsigned long long val)
+{
+    h->bucket[bucket_of(val)]++;
+    h->count++;
+    if (val > h->max)
+	h->max = val;
+}
+
+/*
+ * lathist_percentile - Return the value at percentile pct (0..100), 
+ *     reported as the midpoint of its bucket but never above the max.
+ */
+double lathist_percentile(lathist_t *h, double pct)
+{
+    int b;
+    unsigned long long seen = 0;
+    double rank, mid;
+
+    if (h->count == 0)
+	return 0.0;
+    rank = pct / 100.0 * h->count;
+    if (rank < 1)
+	rank = 1;
+    for (b = 0; b < LATHIST_BUCKETS; b++) {
+	seen += h->bucket[b];
+	if (seen >= rank)
+	    break;
+    }
+    if (b >= LATHIST_BUCKETS - 1)
+	return (double)h->max;
+    mid = (bucket_lo(b) + bucket_lo(b + 1) - 1) / 2.0;
+    return (mid > h->max) ? (double)h->max : mid;
+}
@@ -0,0 +1,28 @@
+/*
+ * lathist.h - prototypes for the log-bucketed latency histograms in lathist.c
+ */
+
+/*
+ * Values are kept in HDR-style buckets: values below LATHIST_SUB get a
+ * bucket of their own, and every power of two above that is split into
+ * LATHIST_SUB equal sub-buckets, so each recorded value is known to 
+ * within 1/LATHIST_SUB (about 6%) of its magnitude.
+ */
+#define LATHIST_SUBBITS 4
+#define LATHIST_SUB     (1 << LATHIST_SUBBITS)
+#define LATHIST_BUCKETS (LATHIST_SUB + (64 - LATHIST_SUBBITS) * LATHIST_SUB)
+
+typedef struct {
+    unsigned long long count;                   /* number of values */
+    unsigned long long max;                     /* largest value seen */
+    unsigned long long bucket[LATHIST_BUCKETS]; /* counts per bucket */
+} lathist_t;
+
+/* Empty the histogram */
+void lathist_init(lathist_t *h);
+
+/* Record a value */
+void lathist_add(lathist_t *h, unsigned long long val);
+
+/* Return the value at percentile pct (0..100) */
+double lathist_percentile(lathist_t *h, double pct);
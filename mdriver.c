@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE         /* for sched_setaffinity and the CPU_xxx macros */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,11 +15,29 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
+#include <math.h>
 #include <time.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "lathist.h"
+#include "perfctr.h"
+#include "sysenv.h"
+#include "evlog.h"
+#include "copy.h"
 #include "config.h"
 
 /**********************
@@ -30,9 +49,18 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* How the speed passes touch the payloads they get back (-w) */
+#define TOUCH_LINE  1    /* write one byte in every cache line */
+#define TOUCH_FULL  2    /* write every byte */
+#define TOUCH_READ  4    /* also read the payload back before freeing it */
+#define LINESIZE   64    /* cache line size assumed by TOUCH_LINE */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
 
+/* Rounds size up to the nearest multiple of ALIGNMENT */
+#define ALIGN(size)    (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+
 /****************************** 
  * The key compound data types 
  *****************************/
@@ -49,18 +77,34 @@ typedef struct {
     enum {ALLOC, FREE, REALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
+    int tid;                          /* thread that issues the request */
+    int dep;                          /* explicit op this one follows, or -1 */
+    int prev;                         /* previous op on the same id, or -1 */
 } traceop_t;
 
-/* Holds the information for one trace file*/
+/* 
+ * Holds the information for one trace file. A trace is read once per
+ * run and is treated as read-only by every evaluation pass.
+ */
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
+    int num_threads;     /* number of distinct thread ids (1 if untagged) */
     traceop_t *ops;      /* array of requests */
+} trace_t;
+
+/* 
+ * Per-pass scratch space. Each pass over a trace records the blocks it
+ * gets back from the allocator here, so the trace itself is never
+ * written. One scratch area sized for the largest trace is reused.
+ */
+typedef struct {
+    int num_ids;         /* number of ids this scratch area can hold */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+} scratch_t;
 
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
@@ -69,9 +113,31 @@ typedef struct {
  */
 typedef struct {
     trace_t *trace;  
+    scratch_t *scratch;
     range_t *ranges;
+    int touch;       /* TOUCH_* flags, or 0 to leave the payloads alone */
 } speed_t;
 
+/* Latency percentiles for one type of request, in nanoseconds */
+typedef struct {
+    double count;    /* number of requests of this type */
+    double p50, p90, p99, p999, max;
+} latency_t;
+
+/* 
+ * Where the heap went at the peak of a trace, as fractions of the peak 
+ * heap size. With the utilization they add up to 1.
+ */
+typedef struct {
+    double metadata;   /* block headers, footers, and other tags */
+    double padding;    /* rounding requests up to ALIGNMENT */
+    double slack;      /* usable bytes beyond the rounded request */
+    double free;       /* bytes in free blocks... */
+    double free_bucket[FRAG_BUCKETS]; /* ... by the size of the block */
+    double heap;       /* bytes outside any block (prologue, epilogue) */
+    double growth;     /* heap the trace only asked for after its peak */
+} frag_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,14 +147,95 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double twutil;   /* time-weighted utilization of resident memory */
+    double resident; /* mean resident heap bytes over the trace */
+    frag_t frag;     /* what the utilization lost went to */
+    double peak_live;/* live payload bytes at the peak */
+    double prof_live;/* ... and the heap profiler's estimate of them (-H) */
+    struct mm_stats mm;       /* mm_stats() after one replay of the trace */
+    struct mm_fitstats fit;   /* ... and mm_fitstats(), if mm.c keeps them */
+    struct mm_profile prof;   /* ... and mm_profile(), likewise */
+    latency_t lat[3];/* per-request latencies, indexed by type (-L only) */
+    double ctr[NUM_PERFCTRS]; /* hardware events per request, -1 if n/a (-P) */
+    fsecs_stats_t timing;     /* the timed runs behind secs (the median) */
+    double run_secs[TIMING_MAXPROCS]; /* secs in each timing process (-r) */
+    int num_runs;             /* ... and how many there were */
+    double touch_secs;        /* secs with the payloads touched (-w only) */
+    double hop_ns;            /* ns per hop chasing the live blocks (-k) */
+    double ref_ns;            /* ... and chasing them packed end to end */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* 
+ * Evaluates some malloc package on trace number tracenum and fills in 
+ * its stats record. These are the units of work handed to the workers.
+ */
+typedef void (*eval_funct)(trace_t *trace, scratch_t *scratch, 
+			   int tracenum, stats_t *stats);
+
+/* 
+ * Shared state for one concurrent replay of a trace. If the trace is 
+ * tagged with thread ids, op i runs on pthread (tid % num_threads) once 
+ * the ops it depends on have completed. An untagged trace is instead
+ * replayed in full by every pthread, each with its own set of blocks.
+ */
+typedef struct {
+    trace_t *trace;         /* the trace being replayed */
+    int num_threads;        /* number of pthreads taking part */
+    int replicate;          /* each pthread replays a private copy? */
+    char **blocks;          /* shared id -> block map for tagged traces */
+    int *done;              /* done[i] is set once op i has completed */
+    int failed;             /* set (atomically) if a request failed */
+    pthread_barrier_t start;/* releases the pthreads and the timer together */
+} mtreplay_t;
+
+/* 
+ * A list of live blocks linked through the first word of each payload,
+ * in allocation order. The xxx_locality functions time walks over it.
+ */
+typedef struct {
+    char *head;             /* first block in the list */
+    int hops;               /* number of blocks in the list */
+} chase_t;
+
+/* A block that eval_mm_copy moves back and forth with mm_realloc */
+typedef struct {
+    char *block;            /* the block, set up by the caller */
+    size_t size;            /* its size */
+} copybench_t;
+
+/* The state of the mm heap at one point in a trace (-s) */
+typedef struct {
+    size_t free_bytes;      /* bytes in free blocks, overhead included */
+    size_t largest_free;    /* size of the largest free block */
+    int free_blocks;        /* number of free blocks */
+} heapinfo_t;
+
+/* Per-pthread state for a concurrent replay */
+typedef struct {
+    mtreplay_t *replay;     /* the replay this pthread belongs to */
+    int id;                 /* pthread number, 0 .. num_threads-1 */
+    double start, end;      /* wall-clock time this pthread ran */
+    pthread_t thread;
+} mtworker_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int latency = 0; /* time every mm request for latency histograms? */
+static int counters = 0;/* count hardware events during eval_mm_speed? */
+static int twutil_every = 0; /* sample resident memory every n requests (-U) */
+static int touch = 0;   /* TOUCH_* flags for the touching speed pass (-w) */
+static unsigned long heapprof = 0; /* heap profiler sampling interval (-H) */
+static char *snapshot_prefix = NULL; /* write heap snapshots here (-d) */
+static volatile char touch_sink; /* keeps payload reads from being elided */
+static int hash_payloads = 0; /* check payloads by content hash (-I) */
+static int checkpoints = 0;   /* locality checkpoints per trace (-k) */
+static int timing_fd = -1;    /* -j workers lock this to time one at a time */
+static int frag_needed = 0;   /* attribute the lost space (for -v and -o)? */
+static volatile long chase_sink; /* keeps pointer chases from being elided */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
@@ -113,20 +260,127 @@ static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static trace_t *read_evtrace(char *path);
+static int evtrace_id(uint64_t *ptrs, int *ids, uint64_t mask, uint64_t ptr);
+static int parse_tag(char *type, int op_index, traceop_t *op);
 static void free_trace(trace_t *trace);
+static trace_t **read_traces(char *tracedir, char **tracefiles, int n);
+static void free_traces(trace_t **traces, int n);
+static scratch_t *alloc_scratch(trace_t **traces, int n);
+static void free_scratch(scratch_t *scratch);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace, int tracenum);
+static int eval_libc_valid(trace_t *trace, scratch_t *scratch, int tracenum);
 static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_valid(trace_t *trace, scratch_t *scratch, int tracenum, 
+			 range_t **ranges);
+static double eval_mm_util(trace_t *trace, scratch_t *scratch, int tracenum, 
+			   range_t **ranges);
+static void eval_mm_twutil(trace_t *trace, scratch_t *scratch, 
+			   stats_t *stats);
+static void eval_mm_frag(trace_t *trace, scratch_t *scratch, 
+			 int tracenum, stats_t *stats);
+static int frag_block(void *bp, size_t size, int alloc, void *ctx);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, scratch_t *scratch, 
+			    stats_t *stats);
+static void eval_mm_counters(speed_t *speed_params, stats_t *stats);
+
+/* These functions check that payloads survive the allocator */
+static long first_mismatch(char *p, long len, int byte);
+static void fill_random(char *p, long len, uint64_t seed);
+static uint64_t payload_hash(char *p, long len);
+
+/* These functions touch payloads the way an application would */
+static int parse_touch(char *spec);
+static void write_payload(char *p, int size, int touch);
+static void read_payload(char *p, int size, int touch);
+
+/* These functions measure how fast a program can walk its live blocks */
+static void eval_locality(trace_t *trace, scratch_t *scratch, int libc,
+			  stats_t *stats);
+static int link_live(trace_t *trace, scratch_t *scratch, int opnum, 
+		     char *live, int *order, chase_t *chase);
+static char *link_packed(trace_t *trace, scratch_t *scratch, int *order, 
+			 int n, int libc, chase_t *chase);
+static double chase_cold(chase_t *chase);
+static void chase_speed(void *ptr);
+
+/* These functions record how fragmentation develops over a trace */
+static void eval_mm_series(trace_t *trace, scratch_t *scratch, 
+			   int tracenum, char *tracefile, int interval, 
+			   FILE *fp);
+static int heapinfo_block(void *bp, size_t size, int alloc, void *ctx);
+
+/* Routines that evaluate a whole trace and record its stats */
+static void eval_libc_trace(trace_t *trace, scratch_t *scratch, 
+			    int tracenum, stats_t *stats);
+static void eval_mm_trace(trace_t *trace, scratch_t *scratch, 
+			  int tracenum, stats_t *stats);
+
+/* These functions spread the traces over one or more workers */
+static void eval_traces(eval_funct f, trace_t **traces, scratch_t *scratch,
+			int n, stats_t *stats, int num_workers);
+static void eval_traces_parallel(eval_funct f, trace_t **traces, 
+				 scratch_t *scratch, int n, stats_t *stats, 
+				 int num_workers);
+static int max_workers(void);
+static void pin_worker(int worker);
+static void timing_lock(int lock);
+static void write_all(int fd, void *buf, size_t len);
+static int read_all(int fd, void *buf, size_t len);
+
+/* These functions replay a trace concurrently on several pthreads */
+static void eval_mm_scaling(trace_t **traces, char **tracefiles, int n,
+			    stats_t *stats, int max_threads);
+static int eval_mm_threads(trace_t *trace, int num_threads, double *secs);
+static void *mt_worker(void *arg);
+static int mt_wait(mtreplay_t *replay, int opnum);
+static double wall_secs(void);
+
+/* This function times the traces again in fresh processes */
+static void eval_mm_runs(trace_t **traces, scratch_t *scratch, int n,
+			 stats_t *stats, int runs);
+
+/* This function measures what guarded sampling costs */
+static void eval_mm_guard(trace_t **traces, scratch_t *scratch, int n);
+
+/* These functions measure mm_realloc's copy engines on large blocks */
+static void eval_mm_copy(void);
+static void copy_speed(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printutil(int n, stats_t *stats);
+static void printfrag(int n, stats_t *stats);
+static void printmmstats(int n, stats_t *stats);
+static void printheapprof(int n, stats_t *stats);
+static void printfitstats(int n, stats_t *stats);
+static void printprofile(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printtiming(int n, stats_t *stats);
+static void printtouch(int n, stats_t *stats);
+static void printlocality(int n, stats_t *stats);
+
+/* These functions save results and compare them against a baseline */
+static void write_results(char *path, sysenv_t *env, char **tracefiles, 
+			  int n, stats_t *stats);
+static void write_results_json(FILE *fp, sysenv_t *env, char **tracefiles, 
+			       int n, stats_t *stats);
+static void write_results_csv(FILE *fp, sysenv_t *env, char **tracefiles, 
+			      int n, stats_t *stats);
+static int compare_results(char *path, sysenv_t *env, char **tracefiles, 
+			   int n, stats_t *stats);
+static int json_number(char *line, char *key, double *val);
+static char *json_string(char *line, char *key, char *buf, int len);
+static void json_write_string(FILE *fp, char *s);
+static int json_numbers(char *line, char *key, double *vals, int max);
+static double runs_median(double *secs, int n, double *spread);
+static double mann_whitney(double *a, int na, double *b, int nb);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -141,14 +395,54 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    trace_t **traces = NULL;   /* every trace file, read once per run */
+    scratch_t *scratch = NULL; /* per-pass block arrays shared by all traces */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int num_workers = 1; /* Number of worker processes (set by -j) */
+    int max_threads = 0; /* If set, replay on 1..max_threads pthreads (-T) */
+    char *results_file = NULL;  /* Write the mm results here (-o) */
+    char *baseline_file = NULL; /* Compare the mm results to this (-c) */
+    int regressions = 0;        /* number of regressions against baseline */
+    int pin_cpu = -1;    /* If set, pin the driver to this CPU (-C) */
+    int realtime = 0;    /* If set, raise the scheduling priority (-R) */
+    int lock_memory = 0; /* If set, lock all memory into RAM (-M) */
+    sysenv_t env;        /* the machine and conditions of this run */
+    char *series_file = NULL;   /* Write the heap time series here (-s) */
+    char heapprof_file[MAXLINE];/* The heap profiler writes here on SIGUSR2 */
+    char *eventlog_file = NULL; /* Write the mm event log here (-E) */
+    int check_every = 0; /* If set, check the mm heap as it is used (-X) */
+    int guard = 0;       /* If set, time mm with guarded sampling (-G) */
+    int copy_bench = 0;  /* If set, time mm's realloc copy engines (-B) */
+    int runs = 1;        /* Time the traces in this many processes (-r) */
+    int fd;
+    int series_interval = SERIES_INTERVAL; /* ops between samples (-S) */
+    FILE *series_fp;
+    struct mm_fitstats fitstats; /* only to ask if mm.c keeps them */
+    struct mm_profile profile;   /* likewise */
+    static struct option long_opts[] = {
+	{"results", required_argument, NULL, 'o'},
+	{"compare", required_argument, NULL, 'c'},
+	{"cpu", required_argument, NULL, 'C'},
+	{"realtime", no_argument, NULL, 'R'},
+	{"mlock", no_argument, NULL, 'M'},
+	{"touch", required_argument, NULL, 'w'},
+	{"locality", required_argument, NULL, 'k'},
+	{"series", required_argument, NULL, 's'},
+	{"heap-profile", required_argument, NULL, 'H'},
+	{"event-log", required_argument, NULL, 'E'},
+	{"snapshot", required_argument, NULL, 'd'},
+	{"check", required_argument, NULL, 'X'},
+	{"guard", no_argument, NULL, 'G'},
+	{"copy", no_argument, NULL, 'B'},
+	{"hash", no_argument, NULL, 'I'},
+	{"twutil", required_argument, NULL, 'U'},
+	{"runs", required_argument, NULL, 'r'},
+	{NULL, 0, NULL, 0}
+    };
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -157,7 +451,8 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:j:T:o:c:C:w:k:s:S:H:E:d:X:U:r:hvVgalBGILPRM", 
+			    long_opts, NULL)) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -180,6 +475,112 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+	case 'L': /* Record per-request latency histograms for mm malloc */
+	    latency = 1;
+	    break;
+	case 'P': /* Count hardware events per request for mm malloc */
+	    counters = 1;
+	    break;
+	case 'o': /* Save the mm results in a JSON or CSV file */
+	    results_file = optarg;
+	    break;
+	case 'c': /* Compare the mm results with a saved JSON baseline */
+	    baseline_file = optarg;
+	    break;
+	case 'C': /* Pin the driver to one CPU */
+	    pin_cpu = atoi(optarg);
+	    break;
+	case 'R': /* Run at raised (real-time if permitted) priority */
+	    realtime = 1;
+	    break;
+	case 'I': /* Check mm payloads by content hash */
+	    hash_payloads = 1;
+	    break;
+	case 'B': /* Time mm realloc of large blocks with each copy engine */
+	    copy_bench = 1;
+	    break;
+	case 'G': /* Time mm malloc with guarded sampling at several rates */
+	    guard = 1;
+	    break;
+	case 'M': /* Lock all memory so page faults don't skew timings */
+	    lock_memory = 1;
+	    break;
+	case 'U': /* Measure time-weighted utilization, sampling every n ops */
+	    twutil_every = atoi(optarg);
+	    if (twutil_every < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'r': /* Time the traces in this many separate processes */
+	    runs = atoi(optarg);
+	    if (runs < 1 || runs > TIMING_MAXPROCS) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'k': /* Time walks over the live blocks at this many points */
+	    checkpoints = atoi(optarg);
+	    if (checkpoints < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'H': /* Run the mm heap profiler, sampling every n bytes */
+	    heapprof = strtoul(optarg, NULL, 0);
+	    if (heapprof == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'X': /* Check the mm heap around every request, all every n */
+	    check_every = atoi(optarg);
+	    if (check_every < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'd': /* Write each trace's heap at its peak to <prefix>-<n>.snap */
+	    snapshot_prefix = optarg;
+	    break;
+	case 'E': /* Write the mm event log here, on SIGUSR1 and on a crash */
+	    eventlog_file = optarg;
+	    break;
+	case 's': /* Write a CSV time series of the mm heap's state */
+	    series_file = optarg;
+	    break;
+	case 'S': /* Sample the heap for the time series every n ops */
+	    series_interval = atoi(optarg);
+	    if (series_interval < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'w': /* Also time the traces with the payloads touched */
+	    if ((touch = parse_touch(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'j': /* Evaluate the traces in parallel worker processes */
+	    num_workers = atoi(optarg);
+	    if (num_workers < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'T': /* Measure scalability with up to this many threads */
+	    max_threads = atoi(optarg);
+	    if (max_threads < 1) {
+		usage();
+		exit(1);
+	    }
+	    if (!mm_is_threadsafe()) {
+		printf("mm.c was not built thread-safe; rebuild it with "
+		       "\"make clean; make MMFLAGS=-DMM_THREADS\" to use -T\n");
+		exit(1);
+	    }
+	    break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -195,6 +596,9 @@ int main(int argc, char **argv)
         }
     }
 
+    /* Only the -v report and the -o results file use eval_mm_frag's */
+    frag_needed = verbose || results_file;
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -205,6 +609,31 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /* 
+     * Steady the machine for benchmarking as requested, and record the 
+     * conditions the run happens under
+     */
+    if (pin_cpu >= 0 && sysenv_pin(pin_cpu) < 0)
+	printf("Warning: could not pin to CPU %d: %s\n", 
+	       pin_cpu, strerror(errno));
+    if (realtime && sysenv_raise_priority() < 0)
+	printf("Warning: could not raise the scheduling priority: %s\n",
+	       strerror(errno));
+    if (lock_memory && sysenv_lock_memory() < 0)
+	printf("Warning: could not lock memory: %s\n", strerror(errno));
+    sysenv_describe(&env);
+    if (verbose)
+	sysenv_print(&env);
+    if (twutil_every && env.locked) {
+	/* locked pages can't be released, and are all resident anyway */
+	printf("Warning: ignoring -U, since memory is locked (-M)\n");
+	twutil_every = 0;
+    }
+
+    /* Read each trace once; all passes below share the cached copies */
+    traces = read_traces(tracedir, tracefiles, num_tracefiles);
+    scratch = alloc_scratch(traces, num_tracefiles);
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -221,25 +650,23 @@ int main(int argc, char **argv)
 	    unix_error("libc_stats calloc in main failed");
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	eval_traces(eval_libc_trace, traces, scratch, num_tracefiles, 
+		    libc_stats, num_workers);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
 	    printf("\nResults for libc malloc:\n");
 	    printresults(num_tracefiles, libc_stats);
+	    printf("\nTiming statistics for libc malloc (usecs):\n");
+	    printtiming(num_tracefiles, libc_stats);
+	    if (touch) {
+		printf("\nThroughput of libc malloc with payloads touched:\n");
+		printtouch(num_tracefiles, libc_stats);
+	    }
+	    if (checkpoints) {
+		printf("\nLocality of libc malloc blocks:\n");
+		printlocality(num_tracefiles, libc_stats);
+	    }
 	}
     }
 
@@ -257,33 +684,127 @@ int main(int argc, char **argv)
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
+    /* Optionally profile the mm heap; SIGUSR2 writes out a profile */
+    if (heapprof) {
+	sprintf(heapprof_file, "mdriver-%d.heap", (int)getpid());
+	if (mm_heapprof_start(heapprof) < 0 ||
+	    mm_heapprof_signal(SIGUSR2, heapprof_file) < 0)
+	    app_error("The mm heap profiler is not available");
+	printf("Heap profiling every %lu bytes; \"kill -USR2 %d\" writes "
+	       "%s\n", heapprof, (int)getpid(), heapprof_file);
+    }
+
+    /* 
+     * Optionally keep the mm event log, written on SIGUSR1, on a crash, 
+     * and after the last trace. Workers would each keep their own, so 
+     * the traces are evaluated in this process.
+     */
+    if (eventlog_file) {
+	if (mm_eventlog_signal(SIGUSR1, eventlog_file) < 0 ||
+	    mm_eventlog_crash(eventlog_file) < 0)
+	    app_error("The mm event log is not available "
+		      "(build mm.c with -DMM_EVENTLOG)");
+	printf("Logging mm requests; \"kill -USR1 %d\" writes %s\n",
+	       (int)getpid(), eventlog_file);
+	num_workers = 1;
+    }
+
+    /* Optionally check the mm heap throughout, timed runs included */
+    if (check_every) {
+	mm_check_every(check_every);
+	printf("Checking the mm heap at every request, all of it every %d\n",
+	       check_every);
+    }
+
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    eval_traces(eval_mm_trace, traces, scratch, num_tracefiles, 
+		mm_stats, num_workers);
+    if (runs > 1 && errors == 0)
+	eval_mm_runs(traces, scratch, num_tracefiles, mm_stats, runs);
+    if (eventlog_file) {
+	if ((fd = open(eventlog_file, O_WRONLY | O_CREAT | O_TRUNC, 
+		       0644)) < 0)
+	    unix_error("Could not open the event log file");
+	if (mm_eventlog_dump(fd) < 0)
+	    unix_error("Could not write the event log file");
+	close(fd);
     }
 
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
+	if (twutil_every) {
+	    printf("\nTime-weighted utilization for mm malloc:\n");
+	    printutil(num_tracefiles, mm_stats);
+	}
+	printf("\nWhere the heap went at the peak, for mm malloc "
+	       "(%% of heap):\n");
+	printfrag(num_tracefiles, mm_stats);
+	printf("\nAllocator statistics for mm malloc:\n");
+	printmmstats(num_tracefiles, mm_stats);
+	if (heapprof) {
+	    printf("\nHeap profile of mm malloc at the peak:\n");
+	    printheapprof(num_tracefiles, mm_stats);
+	}
+	if (mm_fitstats(&fitstats)) {
+	    printf("\nFit searches for mm malloc:\n");
+	    printfitstats(num_tracefiles, mm_stats);
+	}
+	if (mm_profile(&profile)) {
+	    printf("\nTime by phase for mm malloc (%% of profiled time):\n");
+	    printprofile(num_tracefiles, mm_stats);
+	}
+	printf("\nTiming statistics for mm malloc (usecs):\n");
+	printtiming(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (latency) {
+	printf("Request latencies for mm malloc (ns):\n");
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (counters) {
+	printf("Hardware events per request for mm malloc:\n");
+	printcounters(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (touch) {
+	printf("Throughput of mm malloc with payloads touched:\n");
+	printtouch(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (checkpoints) {
+	printf("Locality of mm malloc blocks:\n");
+	printlocality(num_tracefiles, mm_stats);
 	printf("\n");
     }
 
+    /* Optionally record how fragmentation develops over each trace */
+    if (series_file && errors == 0) {
+	if ((series_fp = fopen(series_file, "w")) == NULL)
+	    unix_error("Could not open the time series file");
+	fprintf(series_fp, "trace,file,op,event,request,size,live_bytes,"
+		"heap_bytes,free_bytes,largest_free,free_blocks\n");
+	for (i = 0; i < num_tracefiles; i++)
+	    eval_mm_series(traces[i], scratch, i, tracefiles[i], 
+			   series_interval, series_fp);
+	fclose(series_fp);
+    }
+
+    /* Optionally measure how the mm package scales with threads */
+    if (max_threads > 0 && errors == 0)
+	eval_mm_scaling(traces, tracefiles, num_tracefiles, mm_stats, 
+			max_threads);
+
+    /* Optionally measure what guarded sampling costs */
+    if (guard && errors == 0)
+	eval_mm_guard(traces, scratch, num_tracefiles);
+
+    /* Optionally measure the realloc copy engines */
+    if (copy_bench && errors == 0)
+	eval_mm_copy();
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -332,7 +853,17 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* Save the results and check them against the baseline */
+    if (results_file)
+	write_results(results_file, &env, tracefiles, num_tracefiles, 
+		      mm_stats);
+    if (baseline_file)
+	regressions = compare_results(baseline_file, &env, tracefiles, 
+				      num_tracefiles, mm_stats);
+
+    free_scratch(scratch);
+    free_traces(traces, num_tracefiles);
+    exit(regressions ? 2 : 0);
 }
 
 
@@ -450,6 +981,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     unsigned index, size;
     unsigned max_index = 0;
     unsigned op_index;
+    int *last_op;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -465,6 +997,15 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
+
+    /* An event log dumped by mm.c is a binary trace */
+    if (fread(type, 1, 4, tracefile) == 4 && 
+	memcmp(type, EVTRACE_MAGIC, 4) == 0) {
+	fclose(tracefile);
+	free(trace);
+	return read_evtrace(path);
+    }
+    rewind(tracefile);
     fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
     fscanf(tracefile, "%d", &(trace->num_ids));     
     fscanf(tracefile, "%d", &(trace->num_ops));     
@@ -475,16 +1016,12 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
 	unix_error("malloc 2 failed in read_trace");
 
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+    /* The most recent request on each id, for ordering across threads */
+    if ((last_op = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
 	unix_error("malloc 3 failed in read_trace");
+    memset(last_op, -1, trace->num_ids * sizeof(int));
+    trace->num_threads = 1;
 
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
@@ -514,10 +1051,24 @@ static trace_t *read_trace(char *tracedir, char *filename)
 		   type[0], path);
 	    exit(1);
 	}
+
+	/* Decode the optional thread tag, e.g. "a:2" or "f:1@57" */
+	if (!parse_tag(type, op_index, &trace->ops[op_index])) {
+	    printf("Bogus thread tag (%s) on line %d of tracefile %s\n",
+		   type, LINENUM(op_index), path);
+	    exit(1);
+	}
+	if (trace->ops[op_index].tid >= trace->num_threads)
+	    trace->num_threads = trace->ops[op_index].tid + 1;
+	if (index < trace->num_ids) {
+	    trace->ops[op_index].prev = last_op[index];
+	    last_op[index] = op_index;
+	}
 	op_index++;
 	
     }
     fclose(tracefile);
+    free(last_op);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
     
@@ -525,17 +1076,259 @@ static trace_t *read_trace(char *tracedir, char *filename)
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * read_evtrace - read a binary trace (see evlog.h) and store it in 
+ *     memory. Blocks get ids in the order they were allocated. The log
+ *     may begin after some blocks were allocated; frees and reallocs of
+ *     those can't be replayed and are dropped, as are failed requests.
+ */
+static trace_t *read_evtrace(char *path)
+{
+    FILE *fp;
+    trace_t *trace;
+    traceop_t *op;
+    evtrace_hdr_t hdr;
+    evtrace_rec_t rec;
+    uint64_t i, mask, *ptrs;
+    int *ids, *last_op;
+    int old_id, slot;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_evtrace", path);
+	unix_error(msg);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || 
+	memcmp(hdr.magic, EVTRACE_MAGIC, 4) != 0 ||
+	hdr.version != EVTRACE_VERSION || hdr.num_records > INT_MAX) {
+	sprintf(msg, "%s is not a version %d event log", path, 
+		EVTRACE_VERSION);
+	app_error(msg);
+    }
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL ||
+	(trace->ops = (traceop_t *)malloc((hdr.num_records + 1) * 
+					  sizeof(traceop_t))) == NULL)
+	unix_error("malloc failed in read_evtrace");
+    trace->sugg_heapsize = 0;
+    trace->num_ids = 0;
+    trace->num_ops = 0;
+    trace->weight = 1;
+    trace->num_threads = 1;
+
+    /* Map live block addresses to ids in a table at most half full */
+    for (mask = 1; mask < 2 * hdr.num_records; mask <<= 1)
+	;
+    if ((ptrs = (uint64_t *)calloc(mask, sizeof(uint64_t))) == NULL ||
+	(ids = (int *)malloc(mask * sizeof(int))) == NULL)
+	unix_error("calloc failed in read_evtrace");
+    mask--;
+
+    for (i = 0; i < hdr.num_records; i++) {
+	if (fread(&rec, sizeof(rec), 1, fp) != 1) {
+	    sprintf(msg, "%s ends after %lu of its %lu records", path,
+		    (unsigned long)i, (unsigned long)hdr.num_records);
+	    app_error(msg);
+	}
+	op = &trace->ops[trace->num_ops];
+	op->tid = rec.tid;
+	op->dep = -1;
+	op->prev = -1;
+	op->size = rec.size;
+	old_id = -1;
+	if (rec.op == EV_FREE || rec.op == EV_REALLOC) {
+	    slot = evtrace_id(ptrs, ids, mask, rec.op == EV_FREE ? 
+			      rec.ptr : rec.old);
+	    if (ptrs[slot] != 0 && ids[slot] >= 0) {
+		old_id = ids[slot];
+		ids[slot] = -1;
+	    }
+	}
+	switch (rec.op) {
+	case EV_MALLOC:
+	    if (rec.ptr == 0)
+		continue;
+	    op->type = ALLOC;
+	    op->index = trace->num_ids++;
+	    break;
+	case EV_FREE:
+	    if (old_id < 0)
+		continue;
+	    op->type = FREE;
+	    op->index = old_id;
+	    break;
+	case EV_REALLOC:
+	    if (rec.ptr == 0) {
+		/* A failed realloc leaves the block alone; size 0 frees it */
+		if (old_id < 0)
+		    continue;
+		slot = evtrace_id(ptrs, ids, mask, rec.old);
+		if (rec.size > 0) {
+		    ids[slot] = old_id;
+		    continue;
+		}
+		op->type = FREE;
+		op->index = old_id;
+		break;
+	    }
+	    op->type = old_id < 0 ? ALLOC : REALLOC;
+	    op->index = old_id < 0 ? trace->num_ids++ : old_id;
+	    break;
+	default:
+	    sprintf(msg, "Bogus request type (%d) in record %lu of %s",
+		    rec.op, (unsigned long)i, path);
+	    app_error(msg);
+	}
+	if (op->type != FREE) {
+	    slot = evtrace_id(ptrs, ids, mask, rec.ptr);
+	    ptrs[slot] = rec.ptr;
+	    ids[slot] = op->index;
+	}
+	if (op->tid >= trace->num_threads)
+	    trace->num_threads = op->tid + 1;
+	trace->num_ops++;
+    }
+    fclose(fp);
+    free(ptrs);
+    free(ids);
+    if (trace->num_ops == 0) {
+	sprintf(msg, "%s has no requests that can be replayed", path);
+	app_error(msg);
+    }
+
+    /* The most recent request on each id, for ordering across threads */
+    if ((last_op = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc failed in read_evtrace");
+    memset(last_op, -1, trace->num_ids * sizeof(int));
+    for (i = 0; i < trace->num_ops; i++) {
+	trace->ops[i].prev = last_op[trace->ops[i].index];
+	last_op[trace->ops[i].index] = i;
+    }
+    free(last_op);
+    return trace;
+}
+
+/*
+ * evtrace_id - Find the slot for block address ptr in read_evtrace's
+ *     table: the one holding ptr (with a live id, or -1 once freed), or
+ *     else the empty slot where ptr would go.
+ */
+static int evtrace_id(uint64_t *ptrs, int *ids, uint64_t mask, uint64_t ptr)
+{
+    uint64_t slot = (ptr >> 3) * 0x9e3779b97f4a7c15ULL;
+
+    slot = (slot ^ (slot >> 32)) & mask;
+
+    while (ptrs[slot] != 0 && ptrs[slot] != ptr)
+	slot = (slot + 1) & mask;
+    return (int)slot;
+}
+
+/*
+ * parse_tag - Decode the thread tag that may follow the request type 
+ *     character. ":<tid>" names the issuing thread, and "@<op>" makes
+ *     the request wait for an earlier request (counting from 0) that was
+ *     issued by some other thread. Returns 0 if the tag is malformed.
+ */
+static int parse_tag(char *type, int op_index, traceop_t *op)
+{
+    char *p = type + 1;
+    char *end;
+
+    op->tid = 0;
+    op->dep = -1;
+    op->prev = -1;
+    if (*p == ':') {
+	op->tid = (int)strtol(p + 1, &end, 10);
+	if (end == p + 1 || op->tid < 0)
+	    return 0;
+	p = end;
+    }
+    if (*p == '@') {
+	op->dep = (int)strtol(p + 1, &end, 10);
+	if (end == p + 1 || op->dep < 0 || op->dep >= op_index)
+	    return 0;
+	p = end;
+    }
+    return *p == '\0';
+}
+
+/*
+ * free_trace - Free the trace record and the ops array it points
+ *              to, both of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
+    free(trace->ops);         /* free the ops array... */
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * read_traces - Read each of the n trace files exactly once. The
+ *     resulting array of traces is shared read-only by the libc and
+ *     mm evaluation passes.
+ */
+static trace_t **read_traces(char *tracedir, char **tracefiles, int n)
+{
+    int i;
+    trace_t **traces;
+
+    if ((traces = (trace_t **)calloc(n, sizeof(trace_t *))) == NULL)
+	unix_error("calloc failed in read_traces");
+    for (i = 0; i < n; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+    return traces;
+}
+
+/*
+ * free_traces - Free the array of traces built by read_traces()
+ */
+static void free_traces(trace_t **traces, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	free_trace(traces[i]);
+    free(traces);
+}
+
+/*
+ * alloc_scratch - Allocate block arrays large enough for any of the
+ *     n traces. The same scratch area is reused by every pass.
+ */
+static scratch_t *alloc_scratch(trace_t **traces, int n)
+{
+    int i;
+    scratch_t *scratch;
+
+    if ((scratch = (scratch_t *)malloc(sizeof(scratch_t))) == NULL)
+	unix_error("malloc 1 failed in alloc_scratch");
+
+    scratch->num_ids = 1;
+    for (i = 0; i < n; i++)
+	if (traces[i]->num_ids > scratch->num_ids)
+	    scratch->num_ids = traces[i]->num_ids;
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((scratch->blocks = 
+	 (char **)calloc(scratch->num_ids, sizeof(char *))) == NULL)
+	unix_error("calloc 2 failed in alloc_scratch");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((scratch->block_sizes = 
+	 (size_t *)calloc(scratch->num_ids, sizeof(size_t))) == NULL)
+	unix_error("calloc 3 failed in alloc_scratch");
+
+    return scratch;
+}
+
+/*
+ * free_scratch - Free the scratch area and the two arrays it points to
+ */
+static void free_scratch(scratch_t *scratch)
+{
+    free(scratch->blocks);
+    free(scratch->block_sizes);
+    free(scratch);
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -544,24 +1337,34 @@ void free_trace(trace_t *trace)
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_mm_valid(trace_t *trace, scratch_t *scratch, int tracenum, 
+			 range_t **ranges) 
 {
-    int i, j;
+    int i;
     int index;
     int size;
     int oldsize;
+    long off;
     char *newp;
     char *oldp;
     char *p;
+    char *alive = NULL;       /* which blocks are allocated (-I only) */
+    uint64_t *hashes = NULL;  /* ... and the hashes of their payloads */
+    uint64_t prefix = 0;
+    int valid = 0;
     
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
     clear_ranges(ranges);
+    if (hash_payloads &&
+	((alive = calloc(trace->num_ids, sizeof(char))) == NULL ||
+	 (hashes = calloc(trace->num_ids, sizeof(uint64_t))) == NULL))
+	unix_error("calloc failed in eval_mm_valid");
 
     /* Call the mm package's init function */
     if (mm_init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
-	return 0;
+	goto done;
     }
 
     /* Interpret each operation in the trace in order */
@@ -576,7 +1379,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Call the student's malloc */
 	    if ((p = mm_malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
-		return 0;
+		goto done;
 	    }
 	    
 	    /* 
@@ -585,27 +1388,47 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
-		return 0;
+		goto done;
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
 	     * if we realloc the block and wish to make sure that the old
-	     * data was copied to the new block
+	     * data was copied to the new block. With -I, fill it with data
+	     * that differs from op to op and remember its hash instead.
 	     */
-	    memset(p, index & 0xFF, size);
+	    if (hash_payloads) {
+		fill_random(p, size, ((uint64_t)index << 32) | i);
+		hashes[index] = payload_hash(p, size);
+		alive[index] = 1;
+	    }
+	    else
+		memset(p, index & 0xFF, size);
 
 	    /* Remember region */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
+	    scratch->blocks[index] = p;
+	    scratch->block_sizes[index] = size;
 	    break;
 
         case REALLOC: /* mm_realloc */
 	    
+	    /* With -I, check the payload before it moves */
+	    oldp = scratch->blocks[index];
+	    oldsize = scratch->block_sizes[index];
+	    if (size < oldsize) oldsize = size;
+	    if (hash_payloads) {
+		if (payload_hash(oldp, scratch->block_sizes[index]) != 
+		    hashes[index]) {
+		    malloc_error(tracenum, i, "the payload of the block changed "
+				 "while it was allocated");
+		    goto done;
+		}
+		prefix = payload_hash(oldp, oldsize);
+	    }
+
 	    /* Call the student's realloc */
-	    oldp = trace->blocks[index];
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
-		return 0;
+		goto done;
 	    }
 	    
 	    /* Remove the old region from the range list */
@@ -613,33 +1436,51 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Check new block for correctness and add it to range list */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
-		return 0;
+		goto done;
 	    
 	    /* ADDED: cgw
 	     * Make sure that the new block contains the data from the old 
 	     * block and then fill in the new block with the low order byte
 	     * of the new index
 	     */
-	    oldsize = trace->block_sizes[index];
-	    if (size < oldsize) oldsize = size;
-	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
-		malloc_error(tracenum, i, "mm_realloc did not preserve the "
-			     "data from old block");
-		return 0;
-	      }
+	    if (hash_payloads) {
+		if (payload_hash(newp, oldsize) != prefix) {
+		    malloc_error(tracenum, i, "mm_realloc did not preserve the "
+				 "data from old block (content hash)");
+		    goto done;
+		}
+		fill_random(newp, size, ((uint64_t)index << 32) | i);
+		hashes[index] = payload_hash(newp, size);
+	    }
+	    else {
+		if ((off = first_mismatch(newp, oldsize, index & 0xFF)) >= 0) {
+		    sprintf(msg, "mm_realloc did not preserve the data from "
+			    "old block (first difference at byte %ld of %d)",
+			    off, oldsize);
+		    malloc_error(tracenum, i, msg);
+		    goto done;
+		}
+		memset(newp, index & 0xFF, size);
 	    }
-	    memset(newp, index & 0xFF, size);
 
 	    /* Remember region */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = size;
+	    scratch->blocks[index] = newp;
+	    scratch->block_sizes[index] = size;
 	    break;
 
         case FREE: /* mm_free */
 	    
 	    /* Remove region from list and call student's free function */
-	    p = trace->blocks[index];
+	    p = scratch->blocks[index];
+	    if (hash_payloads) {
+		if (payload_hash(p, scratch->block_sizes[index]) != 
+		    hashes[index]) {
+		    malloc_error(tracenum, i, "the payload of the block changed "
+				 "while it was allocated");
+		    goto done;
+		}
+		alive[index] = 0;
+	    }
 	    remove_range(ranges, p);
 	    mm_free(p);
 	    break;
@@ -650,8 +1491,34 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
     }
 
+    /* With -I, the blocks still allocated must be intact too */
+    if (hash_payloads) {
+	for (index = 0; index < trace->num_ids; index++) {
+	    if (alive[index] && 
+		payload_hash(scratch->blocks[index], 
+			     scratch->block_sizes[index]) != hashes[index]) {
+		sprintf(msg, "the payload of block %d changed while it was "
+			"allocated", index);
+		malloc_error(tracenum, trace->num_ops - 1, msg);
+		goto done;
+	    }
+	}
+    }
+
+    /* The heap it leaves must pass the package's own checks, too */
+    if (mm_check() < 0) {
+	malloc_error(tracenum, trace->num_ops - 1, 
+		     "mm_check found the heap inconsistent.");
+	goto done;
+    }
+
     /* As far as we know, this is a valid malloc package */
-    return 1;
+    valid = 1;
+
+ done:
+    free(alive);
+    free(hashes);
+    return valid;
 }
 
 /* 
@@ -660,12 +1527,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
  *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   package on the trace. mem_sbrk() lets the package trim the heap, 
+ *   so heapsize is taken as the high water mark of brk, not its final
+ *   value. eval_mm_twutil credits trimming instead.
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, scratch_t *scratch, int tracenum, 
+			   range_t **ranges)
 {   
     int i;
     int index;
@@ -691,8 +1559,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
+	    scratch->blocks[index] = p;
+	    scratch->block_sizes[index] = size;
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -706,15 +1574,15 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
-	    oldsize = trace->block_sizes[index];
+	    oldsize = scratch->block_sizes[index];
 
-	    oldp = trace->blocks[index];
+	    oldp = scratch->blocks[index];
 	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = newsize;
+	    scratch->blocks[index] = newp;
+	    scratch->block_sizes[index] = newsize;
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -727,8 +1595,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
         case FREE: /* mm_free */
 	    index = trace->ops[i].index;
-	    size = trace->block_sizes[index];
-	    p = trace->blocks[index];
+	    size = scratch->block_sizes[index];
+	    p = scratch->blocks[index];
 	    
 	    mm_free(p);
 	    
@@ -744,64 +1612,392 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
-
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * eval_mm_frag - Attribute the space the student's package loses to a
+ *   cause. The peak that eval_mm_util divides by is reached at the 
+ *   request after which the most payload is live. The whole trace is
+ *   replayed, and the heap walked at that request. Each allocated block
+ *   is split into
+ *   its payload, the package's metadata (the block less what 
+ *   mm_usable_size says the caller may use), padding up to ALIGNMENT, 
+ *   and slack beyond that, e.g. an unsplit remainder. Free blocks are 
+ *   sorted into size buckets. What the heap grows by beyond its size at
+ *   that request, later in the trace, counts as growth. The shares and
+ *   the payload add up to the peak heap.
  */
-static void eval_mm_speed(void *ptr)
+static void eval_mm_frag(trace_t *trace, scratch_t *scratch, 
+			 int tracenum, stats_t *stats)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    int i, id, fd, peak_op = -1;
+    char *p;
+    char path[MAXLINE];
+    double live = 0, peak_live = 0, heap, heap_at_peak = 0, blocks;
+    double usable = 0, rounded = 0, requested = 0;
+    char *alive;
+    frag_t *frag = &stats->frag;
 
-    /* Reset the heap and initialize the mm package */
+    memset(frag, 0, sizeof(frag_t));
+
+    /* Find the request after which the most payload is live */
+    for (i = 0; i < trace->num_ops; i++) {
+	traceop_t *op = &trace->ops[i];
+
+	if (op->type == ALLOC)
+	    live += op->size;
+	else if (op->type == REALLOC)
+	    live += (double)op->size - scratch->block_sizes[op->index];
+	else
+	    live -= scratch->block_sizes[op->index];
+	scratch->block_sizes[op->index] = (op->type == FREE) ? 0 : op->size;
+	if (live > peak_live) {
+	    peak_live = live;
+	    peak_op = i;
+	}
+    }
+    if (peak_op < 0)
+	return;
+
+    if ((alive = calloc(trace->num_ids, sizeof(char))) == NULL)
+	unix_error("calloc failed in eval_mm_frag");
     mem_reset_brk();
-    if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_frag");
 
-    /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    for (i = 0; i < trace->num_ops; i++) {
+	traceop_t *op = &trace->ops[i];
 
+        switch (op->type) {
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
-            break;
+	    if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc failed in eval_mm_frag");
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    alive[op->index] = 1;
+	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
-            break;
+	    p = mm_realloc(scratch->blocks[op->index], op->size);
+	    if (p == NULL)
+		app_error("mm_realloc failed in eval_mm_frag");
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            mm_free(block);
-            break;
+	    mm_free(scratch->blocks[op->index]);
+	    alive[op->index] = 0;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_frag");
+        }
+	if (i != peak_op)
+	    continue;
+
+	/* At the peak: split up every byte of the heap */
+	for (id = 0; id < trace->num_ids; id++) {
+	    if (!alive[id])
+		continue;
+	    requested += scratch->block_sizes[id];
+	    rounded += ALIGN(scratch->block_sizes[id]);
+	    usable += mm_usable_size(scratch->blocks[id]);
+	}
+	mm_heap_walk(frag_block, frag);   /* bytes in blocks, for now */
+	heap_at_peak = mem_heapsize();
+	blocks = frag->metadata + frag->free;
+	frag->metadata -= usable;
+	frag->padding = rounded - requested;
+	frag->slack = usable - rounded;
+	frag->heap = heap_at_peak - blocks;
+	stats->peak_live = requested;
+	if (heapprof)
+	    stats->prof_live = mm_heapprof_live();
+
+	/* Optionally keep the block map for heapview */
+	if (snapshot_prefix) {
+	    sprintf(path, "%s-%d.snap", snapshot_prefix, tracenum);
+	    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+		mm_heap_snapshot(fd) < 0)
+		unix_error("Could not write the heap snapshot");
+	    close(fd);
+	}
+    }
+    free(alive);
+
+    /* Everything so far is in bytes; make it a share of the peak heap */
+    heap = mem_peak_heapsize();
+    frag->growth = heap - heap_at_peak;
+    frag->metadata /= heap;
+    frag->padding /= heap;
+    frag->slack /= heap;
+    frag->free /= heap;
+    for (i = 0; i < FRAG_BUCKETS; i++)
+	frag->free_bucket[i] /= heap;
+    frag->heap /= heap;
+    frag->growth /= heap;
+}
+
+/*
+ * frag_block - mm_heap_walk callback that adds a block to the frag_t 
+ *    that ctx points to: allocated blocks to metadata (eval_mm_frag 
+ *    takes the usable part back out), free ones to their size bucket
+ */
+static int frag_block(void *bp, size_t size, int alloc, void *ctx)
+{
+    frag_t *frag = (frag_t *)ctx;
+    static size_t limits[FRAG_BUCKETS] = FRAG_BUCKET_LIMITS;
+    int i;
+
+    if (alloc) {
+	frag->metadata += size;
+	return 0;
+    }
+    frag->free += size;
+    for (i = 0; i < FRAG_BUCKETS-1 && size >= limits[i]; i++)
+	;
+    frag->free_bucket[i] += size;
+    return 0;
+}
+
+/*
+ * eval_mm_twutil - Evaluate how well the student's package uses the 
+ *   memory it holds over time. The trace is replayed once more, starting
+ *   with no heap pages resident, and after every twutil_every requests 
+ *   (-U) the live payload bytes and the resident heap bytes (as mincore()
+ *   reports them) are added up. Time is counted in requests. If the heap
+ *   pages can't be released first, the metric is left unmeasured (-1).
+ *   Payloads are written as they are allocated, as a program would, so
+ *   that they are resident. Pages the package never touches, trims off 
+ *   with mem_sbrk(), or hands back with mem_release() aren't resident, 
+ *   so packages that return memory promptly score better than the brk 
+ *   high water mark allows.
+ */
+static void eval_mm_twutil(trace_t *trace, scratch_t *scratch, 
+			   stats_t *stats)
+{
+    int i;
+    char *p;
+    int samples = 0;
+    double live = 0, live_sum = 0, resident_sum = 0;
+
+    mem_reset_brk();
+    if (mem_discard() < 0) {
+	printf("Warning: can't release the heap pages, so twutil isn't "
+	       "measured: %s\n", strerror(errno));
+	return;
+    }
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_twutil");
+
+    for (i = 0; i < trace->num_ops; i++) {
+	traceop_t *op = &trace->ops[i];
+
+        switch (op->type) {
+        case ALLOC: /* mm_malloc */
+	    if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc failed in eval_mm_twutil");
+	    write_payload(p, op->size, TOUCH_LINE);
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    live += op->size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(scratch->blocks[op->index], op->size);
+	    if (p == NULL)
+		app_error("mm_realloc failed in eval_mm_twutil");
+	    write_payload(p, op->size, TOUCH_LINE);
+	    live += (double)op->size - scratch->block_sizes[op->index];
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    break;
+
+        case FREE: /* mm_free */
+	    mm_free(scratch->blocks[op->index]);
+	    live -= scratch->block_sizes[op->index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_twutil");
+        }
+	if ((i + 1) % twutil_every == 0 || i == trace->num_ops - 1) {
+	    live_sum += live;
+	    resident_sum += mem_resident();
+	    samples++;
+	}
+    }
+
+    stats->twutil = (resident_sum > 0) ? live_sum / resident_sum : 0;
+    stats->resident = samples ? resident_sum / samples : 0;
+}
+
+
+/*
+ * eval_mm_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the mm malloc package.
+ */
+static void eval_mm_speed(void *ptr)
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    scratch_t *scratch = ((speed_t *)ptr)->scratch;
+    int touch = ((speed_t *)ptr)->touch;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_speed");
+
+    /* Interpret each trace request */
+    for (i = 0;  i < trace->num_ops;  i++)
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_malloc(size)) == NULL)
+		app_error("mm_malloc error in eval_mm_speed");
+            scratch->blocks[index] = p;
+	    if (touch) {
+		scratch->block_sizes[index] = size;
+		write_payload(p, size, touch);
+	    }
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = scratch->blocks[index];
+            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in eval_mm_speed");
+            scratch->blocks[index] = newp;
+	    if (touch) {
+		scratch->block_sizes[index] = newsize;
+		write_payload(newp, newsize, touch);
+	    }
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            block = scratch->blocks[index];
+	    if (touch & TOUCH_READ)
+		read_payload(block, scratch->block_sizes[index], touch);
+            mm_free(block);
+            break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
+/*
+ * eval_mm_latency - Replay the trace once more, reading the tick counter
+ *    around every mm request. The latencies, less the cost of reading 
+ *    the counter itself, go into one histogram per request type, whose
+ *    percentiles are stored in stats->lat[].
+ */
+static void eval_mm_latency(trace_t *trace, scratch_t *scratch, 
+			    stats_t *stats)
+{
+    int i, type;
+    char *p;
+    unsigned long long t0, t1, ovhd;
+    double ns_per_tick;
+    static lathist_t hist[3];  /* too big for the stack */
+
+    for (type = 0; type < 3; type++)
+	lathist_init(&hist[type]);
+    ovhd = (unsigned long long)ticks_ovhd();
+    ns_per_tick = 1e3 / ticks_mhz();
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	traceop_t *op = &trace->ops[i];
+
+        switch (op->type) {
+        case ALLOC: /* mm_malloc */
+	    t0 = read_ticks();
+	    p = mm_malloc(op->size);
+	    t1 = read_ticks();
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+	    scratch->blocks[op->index] = p;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    p = scratch->blocks[op->index];
+	    t0 = read_ticks();
+	    p = mm_realloc(p, op->size);
+	    t1 = read_ticks();
+	    if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+	    scratch->blocks[op->index] = p;
+	    break;
+
+        case FREE: /* mm_free */
+	    p = scratch->blocks[op->index];
+	    t0 = read_ticks();
+	    mm_free(p);
+	    t1 = read_ticks();
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	    return;
+        }
+	t1 -= t0;
+	lathist_add(&hist[op->type], (t1 > ovhd) ? t1 - ovhd : 0);
+    }
+
+    for (type = 0; type < 3; type++) {
+	latency_t *lat = &stats->lat[type];
+
+	lat->count = hist[type].count;
+	lat->p50 = ns_per_tick * lathist_percentile(&hist[type], 50.0);
+	lat->p90 = ns_per_tick * lathist_percentile(&hist[type], 90.0);
+	lat->p99 = ns_per_tick * lathist_percentile(&hist[type], 99.0);
+	lat->p999 = ns_per_tick * lathist_percentile(&hist[type], 99.9);
+	lat->max = ns_per_tick * hist[type].max;
+    }
+}
+
+/*
+ * eval_mm_counters - Run eval_mm_speed once more with the hardware 
+ *    performance counters enabled, and store the number of events per
+ *    request in stats->ctr[]. Counters that can't be opened read -1.
+ */
+static void eval_mm_counters(speed_t *speed_params, stats_t *stats)
+{
+    int i;
+    double counts[NUM_PERFCTRS];
+
+    if (perfctr_init() == 0) {
+	for (i = 0; i < NUM_PERFCTRS; i++)
+	    stats->ctr[i] = -1;
+	return;
+    }
+    perfctr_start();
+    eval_mm_speed(speed_params);
+    perfctr_stop(counts);
+    for (i = 0; i < NUM_PERFCTRS; i++)
+	stats->ctr[i] = (counts[i] < 0) ? -1 : counts[i] / stats->ops;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
  *    We'll be conservative and terminate if any libc malloc call fails.
  *
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static int eval_libc_valid(trace_t *trace, scratch_t *scratch, int tracenum)
 {
     int i, newsize;
     char *p, *newp, *oldp;
@@ -814,21 +2010,21 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = p;
+	    scratch->blocks[trace->ops[i].index] = p;
 	    break;
 
 	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
+	    oldp = scratch->blocks[trace->ops[i].index];
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
 		malloc_error(tracenum, i, "libc realloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	    scratch->blocks[trace->ops[i].index] = newp;
 	    break;
 	    
         case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+	    free(scratch->blocks[trace->ops[i].index]);
 	    break;
 
 	default:
@@ -850,6 +2046,8 @@ static void eval_libc_speed(void *ptr)
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    scratch_t *scratch = ((speed_t *)ptr)->scratch;
+    int touch = ((speed_t *)ptr)->touch;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -858,88 +2056,2181 @@ static void eval_libc_speed(void *ptr)
 	    size = trace->ops[i].size;
 	    if ((p = malloc(size)) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
+	    scratch->blocks[index] = p;
+	    if (touch) {
+		scratch->block_sizes[index] = size;
+		write_payload(p, size, touch);
+	    }
 	    break;
 
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
+	    oldp = scratch->blocks[index];
 	    if ((newp = realloc(oldp, newsize)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
 	    
-	    trace->blocks[index] = newp;
+	    scratch->blocks[index] = newp;
+	    if (touch) {
+		scratch->block_sizes[index] = newsize;
+		write_payload(newp, newsize, touch);
+	    }
 	    break;
 	    
         case FREE: /* free */
 	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
+	    block = scratch->blocks[index];
+	    if (touch & TOUCH_READ)
+		read_payload(block, scratch->block_sizes[index], touch);
 	    free(block);
 	    break;
 	}
     }
 }
 
-/*************************************
- * Some miscellaneous helper routines
- ************************************/
+/*
+ * eval_libc_trace - Check libc malloc for correctness on one trace
+ *    and, if it is correct, measure its running time.
+ */
+static void eval_libc_trace(trace_t *trace, scratch_t *scratch, 
+			    int tracenum, stats_t *stats)
+{
+    speed_t speed_params;
 
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, scratch, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	speed_params.scratch = scratch;
+	speed_params.ranges = NULL;
+	speed_params.touch = 0;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	timing_lock(1);
+	stats->secs = fsecs_stats(eval_libc_speed, &speed_params, 
+				  &stats->timing);
+	if (touch) {
+	    speed_params.touch = touch;
+	    stats->touch_secs = fsecs(eval_libc_speed, &speed_params);
+	}
+	if (checkpoints)
+	    eval_locality(trace, scratch, 1, stats);
+	timing_lock(0);
+    }
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * eval_mm_trace - Check the mm package for correctness on one trace 
+ *    and, if it is correct, measure its utilization and running time.
  */
-static void printresults(int n, stats_t *stats) 
+static void eval_mm_trace(trace_t *trace, scratch_t *scratch, 
+			  int tracenum, stats_t *stats)
 {
-    int i;
-    double secs = 0;
-    double ops = 0;
-    double util = 0;
+    range_t *ranges = NULL;  /* keeps track of block extents for the trace */
+    speed_t speed_params;
 
-    /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
-    for (i=0; i < n; i++) {
-	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
-		   i,
-		   "yes",
-		   stats[i].util*100.0,
-		   stats[i].ops,
-		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
-	    secs += stats[i].secs;
-	    ops += stats[i].ops;
-	    util += stats[i].util;
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, scratch, tracenum, &ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, scratch, tracenum, &ranges);
+	mm_stats(&stats->mm);
+	mm_fitstats(&stats->fit);
+	mm_profile(&stats->prof);
+	stats->twutil = stats->resident = -1;
+	if (twutil_every)
+	    eval_mm_twutil(trace, scratch, stats);
+	if (frag_needed)
+	    eval_mm_frag(trace, scratch, tracenum, stats);
+	speed_params.trace = trace;
+	speed_params.scratch = scratch;
+	speed_params.ranges = ranges;
+	speed_params.touch = 0;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	timing_lock(1);
+	stats->secs = fsecs_stats(eval_mm_speed, &speed_params, 
+				  &stats->timing);
+	if (latency)
+	    eval_mm_latency(trace, scratch, stats);
+	if (counters)
+	    eval_mm_counters(&speed_params, stats);
+	if (touch) {
+	    speed_params.touch = touch;
+	    stats->touch_secs = fsecs(eval_mm_speed, &speed_params);
 	}
-	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
-		   i,
-		   "no",
-		   "-",
-		   "-",
-		   "-",
-		   "-");
+	if (checkpoints)
+	    eval_locality(trace, scratch, 0, stats);
+	timing_lock(0);
+    }
+    clear_ranges(&ranges);
+}
+
+
+/*****************************************************************
+ * The following routines touch block payloads the way a program
+ * would, so that the speed passes also pay for where the allocator
+ * placed the blocks, not just for the allocator's own code.
+ ****************************************************************/
+
+/*
+ * parse_touch - Convert a -w spec, "line" or "full" optionally followed 
+ *    by ",read", into TOUCH_* flags. Returns 0 if the spec is invalid.
+ */
+static int parse_touch(char *spec)
+{
+    int flags;
+
+    if (strncmp(spec, "line", 4) == 0)
+	flags = TOUCH_LINE;
+    else if (strncmp(spec, "full", 4) == 0)
+	flags = TOUCH_FULL;
+    else
+	return 0;
+    spec += 4;
+    if (strcmp(spec, ",read") == 0)
+	flags |= TOUCH_READ;
+    else if (*spec != '\0')
+	return 0;
+    return flags;
+}
+
+/*
+ * first_mismatch - Return the offset of the first of the len bytes at p
+ *    that isn't byte, or -1 if they all are. Compares 16 bytes at a time
+ *    with SSE2, or 8 at a time without it, after the bytes up to the
+ *    first aligned word.
+ */
+static long first_mismatch(char *p, long len, int byte)
+{
+    long i = 0;
+    uint64_t word = 0x0101010101010101ULL * (unsigned char)byte, diff;
+
+    for (; i < len && ((uintptr_t)(p + i) & 15); i++) {
+	if (p[i] != (char)byte)
+	    return i;
+    }
+#if defined(__SSE2__)
+    {
+	__m128i want = _mm_set1_epi8((char)byte);
+	int mask;
+
+	for (; i + 16 <= len; i += 16) {
+	    mask = _mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_load_si128((__m128i *)(p + i)), want));
+	    if (mask != 0xffff)
+		return i + __builtin_ctz(~mask);
+	}
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+	if ((diff = *(uint64_t *)(p + i) ^ word) != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	    return i + __builtin_ctzll(diff) / 8;
+#else
+	    return i + __builtin_clzll(diff) / 8;
+#endif
 	}
     }
+    for (; i < len; i++) {
+	if (p[i] != (char)byte)
+	    return i;
+    }
+    return -1;
+}
 
-    /* Print the aggregate results for the set of traces */
-    if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
-	       "Total       ",
-	       (util/n)*100.0,
-	       ops, 
-	       secs,
-	       (ops/1e3)/secs);
+/*
+ * fill_random - Fill the len bytes at p with a pseudo-random stream that 
+ *    depends on seed (splitmix64), so that no two blocks look alike
+ */
+static void fill_random(char *p, long len, uint64_t seed)
+{
+    long i;
+    uint64_t z;
+
+    for (i = 0; i < len; i += 8) {
+	z = (seed += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	memcpy(p + i, &z, len - i < 8 ? len - i : 8);
     }
-    else {
-	printf("%12s%6s%8s%10s%6s\n", 
-	       "Total       ",
-	       "-", 
-	       "-", 
-	       "-", 
-	       "-");
+}
+
+/*
+ * payload_hash - A 64-bit hash of the len bytes at p, a word at a time
+ */
+static uint64_t payload_hash(char *p, long len)
+{
+    long i;
+    uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)len, w;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+	memcpy(&w, p + i, 8);
+	h = (h ^ w) * 0x100000001b3ULL;
+	h ^= h >> 29;
+    }
+    for (; i < len; i++)
+	h = (h ^ (unsigned char)p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+/*
+ * write_payload - Write to a block's payload right after it has been 
+ *    allocated: every byte, or one byte in every cache line
+ */
+static void write_payload(char *p, int size, int touch)
+{
+    int i;
+
+    if (touch & TOUCH_FULL) {
+	memset(p, (int)size, size);
+	return;
+    }
+    for (i = 0; i < size; i += LINESIZE)
+	p[i] = (char)i;
+}
+
+/*
+ * read_payload - Read a block's payload back before it is freed, in the
+ *    same pattern in which write_payload wrote it
+ */
+static void read_payload(char *p, int size, int touch)
+{
+    int i, step;
+    char sum = 0;
+
+    step = (touch & TOUCH_FULL) ? 1 : LINESIZE;
+    for (i = 0; i < size; i += step)
+	sum += p[i];
+    touch_sink = sum;
+}
+
+
+/*****************************************************************
+ * The following routines measure the locality of the heap an 
+ * allocator builds: how fast a program can walk its live blocks in
+ * the order it allocated them. The walk is timed with a cold cache
+ * and compared with the same walk over the blocks packed end to end,
+ * which is the best placement any allocator could have chosen.
+ ****************************************************************/
+
+/*
+ * eval_locality - Replay the trace with mm malloc, or with libc malloc
+ *    if libc is set. At each of the checkpoints spread evenly over the
+ *    trace, link the live blocks and time a walk through them. The mean
+ *    ns per hop, and that of the packed walk, go in stats.
+ */
+static void eval_locality(trace_t *trace, scratch_t *scratch, int libc,
+			  stats_t *stats)
+{
+    int i, k, next, num_chased = 0;
+    char *p, *live, *packed;
+    int *order;
+    chase_t chase;
+    double ns = 0, ref_ns = 0;
+
+    if ((live = calloc(trace->num_ids, sizeof(char))) == NULL)
+	unix_error("calloc failed in eval_locality");
+    if ((order = malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc failed in eval_locality");
+
+    if (!libc) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_locality");
     }
 
+    k = 1;
+    next = (int)((double)trace->num_ops * k / (checkpoints + 1));
+    for (i = 0; i < trace->num_ops; i++) {
+	traceop_t *op = &trace->ops[i];
+
+        switch (op->type) {
+        case ALLOC: /* malloc */
+	    p = libc ? malloc(op->size) : mm_malloc(op->size);
+	    if (p == NULL)
+		app_error("malloc failed in eval_locality");
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    live[op->index] = 1;
+	    break;
+
+	case REALLOC: /* realloc */
+	    p = scratch->blocks[op->index];
+	    p = libc ? realloc(p, op->size) : mm_realloc(p, op->size);
+	    if (p == NULL)
+		app_error("realloc failed in eval_locality");
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    break;
+
+        case FREE: /* free */
+	    p = scratch->blocks[op->index];
+	    if (libc)
+		free(p);
+	    else
+		mm_free(p);
+	    live[op->index] = 0;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_locality");
+        }
+
+	/* Time the walks once the op before a checkpoint has completed */
+	while (i == next && k <= checkpoints) {
+	    if (link_live(trace, scratch, i, live, order, &chase) > 1) {
+		ns += chase_cold(&chase) * 1e9 / chase.hops;
+		packed = link_packed(trace, scratch, order, chase.hops, libc,
+				     &chase);
+		ref_ns += chase_cold(&chase) * 1e9 / chase.hops;
+		if (libc)
+		    free(packed);
+		num_chased++;
+	    }
+	    k++;
+	    next = (int)((double)trace->num_ops * k / (checkpoints + 1));
+	}
+    }
+
+    /* Hand anything still live back to libc */
+    if (libc)
+	for (i = 0; i < trace->num_ids; i++)
+	    if (live[i])
+		free(scratch->blocks[i]);
+
+    stats->hop_ns = num_chased ? ns / num_chased : 0;
+    stats->ref_ns = num_chased ? ref_ns / num_chased : 0;
+    free(order);
+    free(live);
+}
+
+/*
+ * link_live - Link the blocks live after op opnum in the order they were
+ *    (re)allocated, writing each one's successor in its first word. 
+ *    Blocks too small to hold a pointer are left out. The ids, in list
+ *    order, go in order[]. Returns the number of blocks in the list.
+ */
+static int link_live(trace_t *trace, scratch_t *scratch, int opnum, 
+		     char *live, int *order, chase_t *chase)
+{
+    int i, id, n = 0;
+
+    /* A block's place is set by its latest alloc or realloc */
+    for (i = opnum; i >= 0; i--) {
+	id = trace->ops[i].index;
+	if (trace->ops[i].type != FREE && live[id] == 1) {
+	    live[id] = 2;  /* seen */
+	    if (scratch->block_sizes[id] >= sizeof(char *))
+		order[n++] = id;
+	}
+    }
+    for (i = 0; i < n / 2; i++) {
+	id = order[i];
+	order[i] = order[n-1-i];
+	order[n-1-i] = id;
+    }
+    for (i = 0; i <= opnum; i++)
+	if (live[trace->ops[i].index] == 2)
+	    live[trace->ops[i].index] = 1;
+
+    for (i = 0; i < n; i++)
+	*(char **)scratch->blocks[order[i]] = 
+	    (i < n-1) ? scratch->blocks[order[i+1]] : NULL;
+    chase->head = n ? scratch->blocks[order[0]] : NULL;
+    chase->hops = n;
+    return n;
+}
+
+/*
+ * link_packed - Lay out the first n blocks of order[] end to end, each
+ *    ALIGNMENT-aligned, and link them in the same order. For mm malloc
+ *    they go in memlib's spare area, on the same mapping as the heap; for
+ *    libc malloc in a fresh buffer from libc, which the caller frees.
+ *    Returns where they went.
+ */
+static char *link_packed(trace_t *trace, scratch_t *scratch, int *order, 
+			 int n, int libc, chase_t *chase)
+{
+    int i;
+    size_t total = 0, offset = 0, size;
+    char *buf, *prev = NULL;
+
+    for (i = 0; i < n; i++)
+	total += ALIGN(scratch->block_sizes[order[i]]);
+    if (!libc)
+	buf = mem_spare();  /* the live bytes always fit in MAX_HEAP */
+    else if ((buf = malloc(total)) == NULL)
+	unix_error("malloc failed in link_packed");
+
+    for (i = 0; i < n; i++) {
+	size = ALIGN(scratch->block_sizes[order[i]]);
+	if (prev)
+	    *(char **)prev = buf + offset;
+	prev = buf + offset;
+	offset += size;
+    }
+    *(char **)prev = NULL;
+    chase->head = buf;
+    chase->hops = n;
+    return buf;
+}
+
+/*
+ * chase_cold - Return the median time (in secs) of CHASE_RUNS walks down
+ *    a chase_t list, each timed on its own right after the cache has been
+ *    cleared by reading CHASE_EVICT times the last level cache's size of
+ *    other bytes
+ */
+static double chase_cold(chase_t *chase)
+{
+    static char *evict = NULL;
+    static long evict_bytes;
+    fsecs_stats_t runs;
+    double start;
+    long i, sum = 0;
+
+    if (evict == NULL) {
+	evict_bytes = CHASE_EVICT * sysenv_llc_size();
+	if ((evict = malloc(evict_bytes)) == NULL)
+	    unix_error("malloc failed in chase_cold");
+	memset(evict, 1, evict_bytes);
+    }
+    for (runs.runs = 0; runs.runs < CHASE_RUNS; runs.runs++) {
+	for (i = 0; i < evict_bytes; i += LINESIZE)
+	    sum += evict[i];
+	start = wall_secs();
+	chase_speed(chase);
+	runs.samples[runs.runs] = wall_secs() - start;
+    }
+    chase_sink += sum;
+    fsecs_summarize(&runs);
+    return runs.median;
+}
+
+/*
+ * chase_speed - Walk once down a chase_t list
+ */
+static void chase_speed(void *ptr)
+{
+    char *p = ((chase_t *)ptr)->head;
+    long hops = 0;
+
+    while (p != NULL) {
+	p = *(char **)p;
+	hops++;
+    }
+    chase_sink = hops;
+}
+
+
+/*****************************************************************
+ * The following routines sample the state of the mm heap over the
+ * course of a trace, to show when fragmentation builds up and which
+ * requests make the heap grow.
+ ****************************************************************/
+
+/*
+ * eval_mm_series - Replay the trace with mm malloc, writing a CSV line
+ *    to fp every interval ops ("sample") and after each op that grew 
+ *    the heap ("grow"). Each line gives the live payload bytes, the 
+ *    heap size, and the free bytes, largest free block, and number of
+ *    free blocks found by walking the heap.
+ */
+static void eval_mm_series(trace_t *trace, scratch_t *scratch, 
+			   int tracenum, char *tracefile, int interval, 
+			   FILE *fp)
+{
+    int i, grew;
+    char *p;
+    size_t live = 0, heapsize;
+    heapinfo_t info;
+    static char *names[3];
+
+    names[ALLOC] = "malloc";
+    names[FREE] = "free";
+    names[REALLOC] = "realloc";
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_series");
+    heapsize = mem_heapsize();
+
+    for (i = 0; i < trace->num_ops; i++) {
+	traceop_t *op = &trace->ops[i];
+
+        switch (op->type) {
+        case ALLOC: /* mm_malloc */
+	    if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc failed in eval_mm_series");
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    live += op->size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(scratch->blocks[op->index], op->size);
+	    if (p == NULL)
+		app_error("mm_realloc failed in eval_mm_series");
+	    live += op->size - scratch->block_sizes[op->index];
+	    scratch->blocks[op->index] = p;
+	    scratch->block_sizes[op->index] = op->size;
+	    break;
+
+        case FREE: /* mm_free */
+	    mm_free(scratch->blocks[op->index]);
+	    live -= scratch->block_sizes[op->index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_series");
+        }
+
+	grew = (mem_heapsize() != heapsize);
+	heapsize = mem_heapsize();
+	if (!grew && (i + 1) % interval != 0 && i != trace->num_ops-1)
+	    continue;
+
+	memset(&info, 0, sizeof(info));
+	mm_heap_walk(heapinfo_block, &info);
+	fprintf(fp, "%d,%s,%d,%s,%s,%d,%lu,%lu,%lu,%lu,%d\n", tracenum, 
+		tracefile, i, grew ? "grow" : "sample", names[op->type], 
+		op->size, (unsigned long)live, (unsigned long)heapsize, 
+		(unsigned long)info.free_bytes, 
+		(unsigned long)info.largest_free, info.free_blocks);
+    }
+}
+
+/*
+ * heapinfo_block - mm_heap_walk callback that adds a block to the 
+ *    heapinfo_t that ctx points to
+ */
+static int heapinfo_block(void *bp, size_t size, int alloc, void *ctx)
+{
+    heapinfo_t *info = (heapinfo_t *)ctx;
+
+    if (!alloc) {
+	info->free_bytes += size;
+	info->free_blocks++;
+	if (size > info->largest_free)
+	    info->largest_free = size;
+    }
+    return 0;
+}
+
+
+/*****************************************************************
+ * The following routines evaluate a set of traces, either one 
+ * after another in this process or spread over worker processes.
+ ****************************************************************/
+
+/*
+ * eval_traces - Run f on each of the n traces, filling in stats[]. With
+ *    more than one worker the traces are handed out to forked workers.
+ */
+static void eval_traces(eval_funct f, trace_t **traces, scratch_t *scratch,
+			int n, stats_t *stats, int num_workers)
+{
+    int i;
+
+    if (num_workers > n)
+	num_workers = n;
+    if (num_workers > 1) {
+	eval_traces_parallel(f, traces, scratch, n, stats, num_workers);
+	return;
+    }
+    for (i = 0; i < n; i++)
+	f(traces[i], scratch, i, &stats[i]);
+}
+
+/*
+ * eval_traces_parallel - Fork num_workers workers. Worker w evaluates
+ *    traces w, w+num_workers, w+2*num_workers, ... on its own copy of 
+ *    the memlib heap and the mm package, pinned to its own CPU. The
+ *    workers check and measure utilization concurrently, but take 
+ *    turns (timing_lock) to time, so that one worker's cache clears and
+ *    memory traffic don't skew another's timings. Each worker sends 
+ *    (tracenum, stats) records back over a pipe, followed by a record 
+ *    with tracenum -1 that carries its error count.
+ */
+static void eval_traces_parallel(eval_funct f, trace_t **traces, 
+				 scratch_t *scratch, int n, stats_t *stats, 
+				 int num_workers)
+{
+    int i, w, status, tracenum, done;
+    int *fds;
+    pid_t *pids;
+    stats_t record;
+    FILE *lockfp;
+    int limit = max_workers();
+
+    /* Timings are only isolated if every worker has a CPU to itself */
+    if (num_workers > limit) {
+	printf("Warning: only %d CPUs available, using %d workers\n", 
+	       limit, limit);
+	num_workers = limit;
+    }
+    if ((fds = (int *)calloc(num_workers, sizeof(int))) == NULL ||
+	(pids = (pid_t *)calloc(num_workers, sizeof(pid_t))) == NULL)
+	unix_error("calloc failed in eval_traces_parallel");
+
+    /* The workers lock this file while they time */
+    if ((lockfp = tmpfile()) == NULL)
+	unix_error("tmpfile failed in eval_traces_parallel");
+    timing_fd = fileno(lockfp);
+
+    /* Don't let the workers inherit (and repeat) buffered output */
+    fflush(stdout);
+
+    for (w = 0; w < num_workers; w++) {
+	int fd[2];
+
+	if (pipe(fd) < 0)
+	    unix_error("pipe failed in eval_traces_parallel");
+	if ((pids[w] = fork()) < 0)
+	    unix_error("fork failed in eval_traces_parallel");
+
+	if (pids[w] == 0) { /* worker */
+	    close(fd[0]);
+	    pin_worker(w);
+	    errors = 0;
+	    for (i = w; i < n; i += num_workers) {
+		f(traces[i], scratch, i, &stats[i]);
+		fflush(stdout);
+		write_all(fd[1], &i, sizeof(int));
+		write_all(fd[1], &stats[i], sizeof(stats_t));
+	    }
+	    i = -1;
+	    write_all(fd[1], &i, sizeof(int));
+	    write_all(fd[1], &errors, sizeof(int));
+	    close(fd[1]);
+	    _exit(0);
+	}
+	close(fd[1]);
+	fds[w] = fd[0];
+    }
+
+    /* Gather the results from each worker in turn */
+    for (w = 0; w < num_workers; w++) {
+	done = 0;
+	while (read_all(fds[w], &tracenum, sizeof(int))) {
+	    if (tracenum < 0) {
+		if (read_all(fds[w], &i, sizeof(int))) {
+		    errors += i;
+		    done = 1;
+		}
+		break;
+	    }
+	    if (tracenum >= n || !read_all(fds[w], &record, sizeof(stats_t)))
+		break;
+	    stats[tracenum] = record;
+	}
+	close(fds[w]);
+	if (waitpid(pids[w], &status, 0) < 0)
+	    unix_error("waitpid failed in eval_traces_parallel");
+
+	/* A worker that crashed invalidates the traces it didn't report */
+	if (!done || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    for (i = w; i < n; i += num_workers) {
+		if (stats[i].ops == 0) {
+		    stats[i].ops = traces[i]->num_ops;
+		    stats[i].valid = 0;
+		    malloc_error(i, 0, "worker terminated abnormally");
+		}
+	    }
+	}
+    }
+    fclose(lockfp);
+    timing_fd = -1;
+    free(fds);
+    free(pids);
+}
+
+/*
+ * max_workers - Return the number of CPUs this process may run on
+ */
+static int max_workers(void)
+{
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &set) < 0)
+	return 1;
+    return CPU_COUNT(&set) > 0 ? CPU_COUNT(&set) : 1;
+}
+
+/*
+ * pin_worker - Pin the calling worker to the w-th CPU it may run on
+ */
+static void pin_worker(int worker)
+{
+    cpu_set_t set, pin;
+    int cpu, k = 0;
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &set) < 0)
+	return;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+	if (CPU_ISSET(cpu, &set) && k++ == worker) {
+	    CPU_ZERO(&pin);
+	    CPU_SET(cpu, &pin);
+	    if (sched_setaffinity(0, sizeof(cpu_set_t), &pin) < 0 && verbose)
+		printf("Warning: could not pin worker %d to CPU %d\n", 
+		       worker, cpu);
+	    return;
+	}
+    }
+}
+
+/*
+ * timing_lock - Take (lock=1) or give up (lock=0) the right to time, 
+ *    so that -j workers time one at a time. A no-op outside workers. 
+ *    It is a POSIX record lock rather than a token passed over a pipe
+ *    because the kernel drops the lock of a worker that crashes.
+ */
+static void timing_lock(int lock)
+{
+    struct flock fl;
+
+    if (timing_fd < 0)
+	return;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = lock ? F_WRLCK : F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(timing_fd, F_SETLKW, &fl) < 0) {
+	if (errno != EINTR)
+	    unix_error("fcntl failed in timing_lock");
+    }
+}
+
+/*
+ * write_all - Write exactly len bytes to fd, retrying short writes
+ */
+static void write_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    ssize_t rc;
+
+    while (len > 0) {
+	if ((rc = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("write failed in write_all");
+	}
+	p += rc;
+	len -= rc;
+    }
+}
+
+/*
+ * read_all - Read exactly len bytes from fd. Returns 0 on a premature EOF.
+ */
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    ssize_t rc;
+
+    while (len > 0) {
+	if ((rc = read(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("read failed in read_all");
+	}
+	if (rc == 0)
+	    return 0;
+	p += rc;
+	len -= rc;
+    }
+    return 1;
+}
+
+/*****************************************************************
+ * The following routines replay a trace concurrently on several 
+ * pthreads to measure how the (thread-safe) mm package scales.
+ ****************************************************************/
+
+/*
+ * eval_mm_scaling - For each trace, report the throughput of the mm 
+ *    package when the trace is replayed on 1, 2, ..., max_threads 
+ *    pthreads. Each thread count is timed a few times and the best 
+ *    run is reported. An untagged trace runs a copy per pthread, all in
+ *    the one MAX_HEAP heap, so thread counts whose copies can't fit by
+ *    the trace's peak heap (in stats) are skipped.
+ */
+static void eval_mm_scaling(trace_t **traces, char **tracefiles, int n,
+			    stats_t *stats, int max_threads)
+{
+    int i, k, run, ok;
+    double secs, best, ops, base = 0;
+
+    for (i = 0; i < n; i++) {
+	printf("\nScalability of mm malloc on trace %d (%s, %s):\n", 
+	       i, tracefiles[i], traces[i]->num_threads > 1 ? 
+	       "tagged threads" : "one copy per thread");
+	printf("%7s%10s%10s%8s%8s\n", 
+	       "threads", "ops", "secs", "Kops", "speedup");
+	for (k = 1; k <= max_threads; k++) {
+	    if (traces[i]->num_threads == 1 &&
+		(double)k * stats[i].mm.peak_heap_bytes > MAX_HEAP) {
+		printf("%7d%10.0f  skipped: %d copies need %.1f MB of "
+		       "heap\n", k, (double)traces[i]->num_ops * k, k, 
+		       k * stats[i].mm.peak_heap_bytes / (1024.0*1024.0));
+		continue;
+	    }
+	    best = DBL_MAX;
+	    for (run = 0, ok = 1; run < 3 && ok; run++) {
+		if ((ok = eval_mm_threads(traces[i], k, &secs)) && secs < best)
+		    best = secs;
+	    }
+	    ops = (double)traces[i]->num_ops;
+	    if (traces[i]->num_threads == 1)
+		ops *= k;
+	    if (!ok) {
+		printf("%7d%10.0f%10s%8s%8s\n", k, ops, "-", "-", "-");
+		continue;
+	    }
+	    if (k == 1)
+		base = ops / best;
+	    printf("%7d%10.0f%10.6f%8.0f%8.2f\n", k, ops, best, 
+		   (ops/1e3)/best, (ops/best)/base);
+	}
+    }
+    printf("\n");
+}
+
+/*
+ * eval_mm_threads - Replay a trace once on num_threads pthreads and 
+ *    store the elapsed wall-clock time in *secs. Returns 0 if some 
+ *    request failed (e.g. the simulated heap ran out of memory).
+ */
+static int eval_mm_threads(trace_t *trace, int num_threads, double *secs)
+{
+    int i, ok;
+    double start, end;
+    mtreplay_t replay;
+    mtworker_t *workers;
+
+    replay.trace = trace;
+    replay.num_threads = num_threads;
+    replay.replicate = (trace->num_threads == 1);
+    replay.failed = 0;  /* before the pthreads exist */
+    if ((replay.blocks = (char **)calloc(trace->num_ids, sizeof(char *))) 
+	== NULL ||
+	(replay.done = (int *)calloc(trace->num_ops, sizeof(int))) == NULL ||
+	(workers = (mtworker_t *)calloc(num_threads, sizeof(mtworker_t))) 
+	== NULL)
+	unix_error("calloc failed in eval_mm_threads");
+    pthread_barrier_init(&replay.start, NULL, num_threads + 1);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_threads");
+
+    for (i = 0; i < num_threads; i++) {
+	workers[i].replay = &replay;
+	workers[i].id = i;
+	if (pthread_create(&workers[i].thread, NULL, mt_worker, &workers[i]))
+	    app_error("pthread_create failed in eval_mm_threads");
+    }
+
+    /* Time from the first thread starting until the last one ends */
+    pthread_barrier_wait(&replay.start);
+    for (i = 0; i < num_threads; i++)
+	pthread_join(workers[i].thread, NULL);
+    start = workers[0].start;
+    end = workers[0].end;
+    for (i = 1; i < num_threads; i++) {
+	start = (workers[i].start < start) ? workers[i].start : start;
+	end = (workers[i].end > end) ? workers[i].end : end;
+    }
+    *secs = end - start;
+
+    ok = !__atomic_load_n(&replay.failed, __ATOMIC_ACQUIRE);
+    pthread_barrier_destroy(&replay.start);
+    free(workers);
+    free(replay.done);
+    free(replay.blocks);
+    return ok;
+}
+
+/*
+ * mt_worker - Body of one replay pthread. Runs the ops assigned to it
+ *    in trace order, waiting on the happens-before edge of each op: 
+ *    its explicit "@" dependency and the previous op on the same id.
+ */
+static void *mt_worker(void *arg)
+{
+    mtworker_t *worker = (mtworker_t *)arg;
+    mtreplay_t *replay = worker->replay;
+    trace_t *trace = replay->trace;
+    traceop_t *op;
+    char **blocks = replay->blocks;
+    char *p;
+    int i;
+
+    if (replay->replicate &&
+	(blocks = (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
+	unix_error("calloc failed in mt_worker");
+
+    pthread_barrier_wait(&replay->start);
+    worker->start = wall_secs();
+    for (i = 0; i < trace->num_ops && 
+	     !__atomic_load_n(&replay->failed, __ATOMIC_ACQUIRE); i++) {
+	op = &trace->ops[i];
+	if (!replay->replicate) {
+	    if (op->tid % replay->num_threads != worker->id)
+		continue;
+	    if (!mt_wait(replay, op->dep) || !mt_wait(replay, op->prev))
+		break;
+	}
+
+        p = NULL;
+        switch (op->type) {
+        case ALLOC: /* mm_malloc */
+	    p = mm_malloc(op->size);
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(blocks[op->index], op->size);
+	    break;
+
+        case FREE: /* mm_free */
+	    mm_free(blocks[op->index]);
+	    break;
+	}
+
+	/* 
+	 * A failed request stops the replay before op i is published, so
+	 * no pthread goes on to use its block; those waiting on it give up
+	 */
+	if (op->type != FREE) {
+	    if (p == NULL) {
+		__atomic_store_n(&replay->failed, 1, __ATOMIC_RELEASE);
+		break;
+	    }
+	    blocks[op->index] = p;
+	}
+
+	/* Publish the blocks array update to the pthreads that wait on i */
+	if (!replay->replicate)
+	    __atomic_store_n(&replay->done[i], 1, __ATOMIC_RELEASE);
+    }
+
+    worker->end = wall_secs();
+    if (replay->replicate)
+	free(blocks);
+    return NULL;
+}
+
+/*
+ * mt_wait - Wait until op opnum (if any) has completed. Returns 0 if 
+ *    the replay was abandoned while waiting.
+ */
+static int mt_wait(mtreplay_t *replay, int opnum)
+{
+    if (opnum < 0)
+	return 1;
+    while (!__atomic_load_n(&replay->done[opnum], __ATOMIC_ACQUIRE)) {
+	if (__atomic_load_n(&replay->failed, __ATOMIC_ACQUIRE))
+	    return 0;
+	sched_yield();
+    }
+    return 1;
+}
+
+/*
+ * wall_secs - Return the current monotonic wall-clock time in seconds
+ */
+static double wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1E-9*ts.tv_nsec;
+}
+
+/*
+ * eval_mm_runs - Time every valid trace again in each of runs-1 worker
+ *    processes, forked one after the other, and store the median secs of
+ *    every run (this process's first) in stats[i].run_secs. Where the 
+ *    pages land and what else the machine does change from process to 
+ *    process, so only these runs show how much throughput really varies.
+ */
+static void eval_mm_runs(trace_t **traces, scratch_t *scratch, int n,
+			 stats_t *stats, int runs)
+{
+    int i, r, fd[2], status;
+    double secs;
+    pid_t pid;
+    speed_t speed_params;
+
+    for (i = 0; i < n; i++) {
+	stats[i].run_secs[0] = stats[i].secs;
+	stats[i].num_runs = 1;
+    }
+    speed_params.scratch = scratch;
+    speed_params.ranges = NULL;
+    speed_params.touch = 0;
+    fflush(stdout);
+
+    for (r = 1; r < runs; r++) {
+	if (pipe(fd) < 0)
+	    unix_error("pipe failed in eval_mm_runs");
+	if ((pid = fork()) < 0)
+	    unix_error("fork failed in eval_mm_runs");
+	if (pid == 0) { /* worker */
+	    close(fd[0]);
+	    for (i = 0; i < n; i++) {
+		secs = 0;
+		if (stats[i].valid) {
+		    speed_params.trace = traces[i];
+		    secs = fsecs(eval_mm_speed, &speed_params);
+		}
+		write_all(fd[1], &secs, sizeof(double));
+	    }
+	    close(fd[1]);
+	    _exit(0);
+	}
+	close(fd[1]);
+	for (i = 0; i < n && read_all(fd[0], &secs, sizeof(double)); i++)
+	    if (stats[i].valid)
+		stats[i].run_secs[stats[i].num_runs++] = secs;
+	close(fd[0]);
+	if (waitpid(pid, &status, 0) < 0)
+	    unix_error("waitpid failed in eval_mm_runs");
+	if (i < n || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    printf("Warning: timing run %d terminated abnormally\n", r);
+    }
+}
+
+/*
+ * eval_mm_guard - Time every trace with mm's guarded sampling off, and
+ *    on at each of the GUARD_RATES, and print the total throughput and
+ *    its cost. The settings take turns for GUARD_ROUNDS rounds, in an
+ *    order rotated each round, so that drift in the machine's speed hits
+ *    them all alike; an untimed round warms up first. Each round's cost
+ *    is against the same round with sampling off, and the median cost is
+ *    printed with its 95% confidence interval over the rounds. The 
+ *    blocks guarded are counted on the last round.
+ */
+static void eval_mm_guard(trace_t **traces, scratch_t *scratch, int n)
+{
+    static unsigned long rates[] = GUARD_RATES;
+    static fsecs_stats_t times[sizeof(rates) / sizeof(rates[0]) + 1];
+    static fsecs_stats_t costs[sizeof(rates) / sizeof(rates[0]) + 1];
+    unsigned long guarded[sizeof(rates) / sizeof(rates[0]) + 1];
+    int i, j, k, c, num_confs = sizeof(rates) / sizeof(rates[0]) + 1;
+    double start, secs, ops = 0;
+    speed_t speed_params;
+    struct mm_stats mm;
+
+    if (mm_guard_start(0) < 0)
+	app_error("mm guarded sampling is not available");
+    for (i = 0; i < n; i++)
+	ops += traces[i]->num_ops;
+    speed_params.scratch = scratch;
+    speed_params.ranges = NULL;
+    speed_params.touch = 0;
+    memset(times, 0, sizeof(times));
+
+    /* Setting c is off for c = 0, and one in rates[c-1] otherwise */
+    for (k = -1; k < GUARD_ROUNDS; k++) {
+	for (j = 0; j < num_confs; j++) {
+	    c = (j + (k < 0 ? 0 : k)) % num_confs;
+	    mm_guard_start(c ? rates[c-1] : 0);
+	    secs = 0;
+	    guarded[c] = 0;
+	    for (i = 0; i < n; i++) {
+		speed_params.trace = traces[i];
+		start = wall_secs();
+		eval_mm_speed(&speed_params);
+		secs += wall_secs() - start;
+		mm_stats(&mm);
+		guarded[c] += mm.guarded;
+	    }
+	    if (k >= 0)
+		times[c].samples[times[c].runs++] = secs;
+	}
+    }
+    mm_guard_start(0);
+
+    for (c = 0; c < num_confs; c++) {
+	costs[c].runs = GUARD_ROUNDS;
+	for (k = 0; k < GUARD_ROUNDS; k++)
+	    costs[c].samples[k] = times[c].samples[k] / times[0].samples[k] - 1;
+	fsecs_summarize(&times[c]);
+	fsecs_summarize(&costs[c]);
+    }
+
+    printf("Throughput of mm malloc with guarded sampling "
+	   "(median of %d rounds):\n", GUARD_ROUNDS);
+    printf("%10s%10s%10s%10s%10s%20s\n", 
+	   "1 in", "guarded", "secs", "Kops", "cost", "95% CI of cost");
+    for (c = 0; c < num_confs; c++) {
+	secs = times[c].median;
+	if (c == 0) {
+	    printf("%10s%10lu%10.6f%10.0f%10s\n", "off", guarded[c], secs,
+		   (ops/1e3)/secs, "-");
+	    continue;
+	}
+	printf("%10lu%10lu%10.6f%10.0f%9.1f%%%10.1f%%%9.1f%%\n", rates[c-1],
+	       guarded[c], secs, (ops/1e3)/secs, 100.0 * costs[c].median, 
+	       100.0 * costs[c].ci_lo, 100.0 * costs[c].ci_hi);
+    }
+    printf("\n");
+}
+
+/*
+ * eval_mm_copy - Time mm_realloc moving blocks of each of COPY_SIZES
+ *    with each copy engine the CPU supports, streaming every copy (the
+ *    default threshold, printed first, keeps small ones in the cache).
+ *    Prints the copy rate, and what reading a working set of 
+ *    COPY_WORKING_SET bytes costs after each move, which is more the 
+ *    more of it the copy evicted. Leaves mm with the default engine.
+ */
+static void eval_mm_copy(void)
+{
+    static size_t sizes[] = COPY_SIZES;
+    int i, j, k, e, num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    double secs, read_secs, start;
+    char *hot, sum = 0;
+    copybench_t bench;
+
+    if ((hot = malloc(COPY_WORKING_SET)) == NULL)
+	unix_error("malloc failed in eval_mm_copy");
+    memset(hot, 1, COPY_WORKING_SET);
+    mm_copy_engine(COPY_AUTO, 0);
+    printf("Throughput of mm realloc of large blocks (streamed by default "
+	   "from %lu bytes),\nand the time to read a %d-byte working set "
+	   "after each move:\n", (unsigned long)copy_threshold(), 
+	   COPY_WORKING_SET);
+    printf("%10s%10s%10s%12s\n", "bytes", "engine", "MB/s", "read usecs");
+    for (i = 0; i < num_sizes; i++) {
+	for (e = 0; e < COPY_ENGINES; e++) {
+	    if (mm_copy_engine(e, 1) < 0)
+		continue;
+	    /* Set up one block; each realloc moves it to the other place */
+	    mem_reset_brk();
+	    if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_copy");
+	    bench.size = sizes[i];
+	    if ((bench.block = mm_malloc(bench.size)) == NULL ||
+		(bench.block = mm_realloc(bench.block, bench.size)) == NULL)
+		app_error("mm_malloc failed in eval_mm_copy");
+	    memset(bench.block, e + 1, bench.size);
+	    secs = fsecs(copy_speed, &bench);
+
+	    /* Then read the working set, warm to begin with, after moves */
+	    read_secs = 0;
+	    for (j = 0; j < COPY_WORKING_SET; j += LINESIZE)
+		sum += hot[j];
+	    for (k = 0; k < COPY_MOVES; k++) {
+		copy_speed(&bench);
+		start = wall_secs();
+		for (j = 0; j < COPY_WORKING_SET; j += LINESIZE)
+		    sum += hot[j];
+		read_secs += wall_secs() - start;
+	    }
+	    printf("%10lu%10s%10.0f%12.2f\n", (unsigned long)bench.size,
+		   copy_names[e], COPY_MOVES * (bench.size / 1e6) / secs,
+		   1e6 * read_secs / COPY_MOVES);
+	}
+    }
+    touch_sink = sum;
+    mm_copy_engine(COPY_AUTO, 0);
+    free(hot);
+    printf("\n");
+}
+
+/*
+ * copy_speed - Move the block COPY_MOVES times. The function that fsecs
+ *    times.
+ */
+static void copy_speed(void *ptr)
+{
+    copybench_t *bench = ptr;
+    int i;
+
+    for (i = 0; i < COPY_MOVES; i++) {
+	if ((bench->block = mm_realloc(bench->block, bench->size)) == NULL)
+	    app_error("mm_realloc failed in copy_speed");
+    }
+}
+
+/*****************************************************************
+ * The following routines save the mm results in a machine-readable
+ * file and compare a run against a saved baseline.
+ ****************************************************************/
+
+/*
+ * write_results - Save the per-trace mm results in path, as CSV if the
+ *    name ends in ".csv" and as JSON otherwise.
+ */
+static void write_results(char *path, sysenv_t *env, char **tracefiles, 
+			  int n, stats_t *stats)
+{
+    FILE *fp;
+    size_t len = strlen(path);
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_results", path);
+	unix_error(msg);
+    }
+    if (len > 4 && strcmp(path + len - 4, ".csv") == 0)
+	write_results_csv(fp, env, tracefiles, n, stats);
+    else
+	write_results_json(fp, env, tracefiles, n, stats);
+    fclose(fp);
+}
+
+/*
+ * write_results_json - Write the environment and then one JSON object
+ *    per trace, each on a line of its own (compare_results depends on 
+ *    that). Time-weighted utilization, latencies and counters are null
+ *    unless measured (-U, -L, -P).
+ */
+static void write_results_json(FILE *fp, sysenv_t *env, char **tracefiles, 
+			       int n, stats_t *stats)
+{
+    int i, j, type;
+    static char *names[3];
+    char *keys[] = {"host", "kernel", "cpu_model", "governor", "sched"};
+    char *vals[5];
+
+    names[ALLOC] = "malloc";
+    names[FREE] = "free";
+    names[REALLOC] = "realloc";
+
+    vals[0] = env->host;
+    vals[1] = env->kernel;
+    vals[2] = env->cpu_model;
+    vals[3] = env->governor;
+    vals[4] = env->sched;
+    fprintf(fp, "{\"env\": {");
+    for (j = 0; j < 5; j++) {
+	fprintf(fp, "\"%s\": ", keys[j]);
+	json_write_string(fp, vals[j]);
+	fprintf(fp, ", ");
+    }
+    fprintf(fp, "\"cpu\": %d, \"cpu_mhz\": %.0f, \"max_mhz\": %.0f, "
+	    "\"locked\": %d},\n", env->cpu, env->cur_mhz, env->max_mhz, 
+	    env->locked);
+    fprintf(fp, "\"traces\": [\n");
+    for (i = 0; i < n; i++) {
+	stats_t *st = &stats[i];
+	fsecs_stats_t *t = &st->timing;
+
+	fprintf(fp, "{\"trace\": %d, \"file\": ", i);
+	json_write_string(fp, tracefiles[i]);
+	fprintf(fp, ", \"valid\": %d, \"ops\": %.0f, \"util\": %.6f, ",
+		st->valid, st->ops, st->util);
+	if (st->twutil >= 0)
+	    fprintf(fp, "\"twutil\": %.6f, \"resident\": %.0f, ", 
+		    st->twutil, st->resident);
+	else
+	    fprintf(fp, "\"twutil\": null, \"resident\": null, ");
+	fprintf(fp, "\"secs\": %.9g, "
+		"\"kops\": %.3f, \"mad\": %.9g, \"ci_lo\": %.9g, "
+		"\"ci_hi\": %.9g, \"runs\": %d, ", st->secs,
+		st->secs > 0 ? (st->ops/1e3)/st->secs : 0.0, 
+		t->mad, t->ci_lo, t->ci_hi, t->runs);
+	fprintf(fp, "\"run_secs\": [");
+	for (j = 0; j < st->num_runs; j++)
+	    fprintf(fp, "%s%.9g", j ? ", " : "", st->run_secs[j]);
+	fprintf(fp, "], ");
+
+	fprintf(fp, "\"frag\": {\"metadata\": %.6f, \"padding\": %.6f, "
+		"\"slack\": %.6f, \"free\": %.6f, \"heap\": %.6f, "
+		"\"growth\": %.6f, \"free_buckets\": [", st->frag.metadata, 
+		st->frag.padding, st->frag.slack, st->frag.free, 
+		st->frag.heap, st->frag.growth);
+	for (j = 0; j < FRAG_BUCKETS; j++)
+	    fprintf(fp, "%s%.6f", j ? ", " : "", st->frag.free_bucket[j]);
+	fprintf(fp, "]}, ");
+
+	fprintf(fp, "\"mm_stats\": {\"mallocs\": %lu, \"frees\": %lu, "
+		"\"reallocs\": %lu, "
+		"\"realloc_moved\": %lu, \"fit_hits\": %lu, "
+		"\"fit_misses\": %lu, \"extend_heaps\": %lu, "
+		"\"coalesces\": [%lu, %lu, %lu, %lu], \"heap_bytes\": %lu, "
+		"\"peak_heap_bytes\": %lu, \"live_bytes\": %lu, "
+		"\"class_mallocs\": [", st->mm.mallocs, st->mm.frees, 
+		st->mm.reallocs, st->mm.realloc_moved,
+		st->mm.fit_hits, st->mm.fit_misses, st->mm.extend_heaps, 
+		st->mm.coalesces[0], st->mm.coalesces[1], st->mm.coalesces[2],
+		st->mm.coalesces[3], st->mm.heap_bytes, 
+		st->mm.peak_heap_bytes, st->mm.live_bytes);
+	for (j = 0; j < MM_SIZE_CLASSES; j++)
+	    fprintf(fp, "%s%lu", j ? ", " : "", st->mm.class_mallocs[j]);
+	fprintf(fp, "]}, ");
+
+	fprintf(fp, "\"fit_stats\": ");
+	if (st->fit.searches > 0) {
+	    fprintf(fp, "{\"searches\": %lu, \"probes\": %lu, "
+		    "\"max_probes\": %lu, \"wraps\": %lu, \"failures\": %lu, "
+		    "\"probe_hist\": [", st->fit.searches, st->fit.probes, 
+		    st->fit.max_probes, st->fit.wraps, st->fit.failures);
+	    for (j = 0; j < MM_FIT_BUCKETS; j++)
+		fprintf(fp, "%s%lu", j ? ", " : "", st->fit.probe_hist[j]);
+	    fprintf(fp, "]}, ");
+	}
+	else
+	    fprintf(fp, "null, ");
+
+	fprintf(fp, "\"touch_secs\": ");
+	if (touch)
+	    fprintf(fp, "%.9g, ", st->touch_secs);
+	else
+	    fprintf(fp, "null, ");
+
+	fprintf(fp, "\"locality\": ");
+	if (checkpoints)
+	    fprintf(fp, "{\"hop_ns\": %.3f, \"packed_ns\": %.3f}, ", 
+		    st->hop_ns, st->ref_ns);
+	else
+	    fprintf(fp, "null, ");
+
+	fprintf(fp, "\"latency\": ");
+	if (latency) {
+	    fprintf(fp, "{");
+	    for (type = 0; type < 3; type++) {
+		latency_t *lat = &st->lat[type];
+
+		fprintf(fp, "%s\"%s\": {\"count\": %.0f, \"p50\": %.1f, "
+			"\"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+			"\"max\": %.1f}", type ? ", " : "", names[type], 
+			lat->count, lat->p50, lat->p90, lat->p99, 
+			lat->p999, lat->max);
+	    }
+	    fprintf(fp, "}, ");
+	}
+	else
+	    fprintf(fp, "null, ");
+
+	fprintf(fp, "\"counters\": ");
+	if (counters) {
+	    fprintf(fp, "{");
+	    for (j = 0; j < NUM_PERFCTRS; j++) {
+		fprintf(fp, "%s\"%s\": ", j ? ", " : "", perfctr_name(j));
+		if (st->ctr[j] >= 0)
+		    fprintf(fp, "%.4f", st->ctr[j]);
+		else
+		    fprintf(fp, "null");
+	    }
+	    fprintf(fp, "}, ");
+	}
+	else
+	    fprintf(fp, "null, ");
+
+	fprintf(fp, "\"samples\": [");
+	for (j = 0; j < t->runs; j++)
+	    fprintf(fp, "%s%.9g", j ? ", " : "", t->samples[j]);
+	fprintf(fp, "]}%s\n", (i < n-1) ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+}
+
+/*
+ * write_results_csv - Write a header line and one line per trace. 
+ *    Unmeasured values are left empty, every line repeats the run's 
+ *    environment, and the timing samples are joined by ';' in the 
+ *    last column.
+ */
+static void write_results_csv(FILE *fp, sysenv_t *env, char **tracefiles, 
+			      int n, stats_t *stats)
+{
+    int i, j, type;
+    static char *names[3];
+
+    names[ALLOC] = "malloc";
+    names[FREE] = "free";
+    names[REALLOC] = "realloc";
+
+    fprintf(fp, "trace,file,valid,ops,util,twutil,resident,secs,kops,mad,"
+	    "ci_lo,ci_hi,runs,frag_metadata,frag_padding,frag_slack,frag_free,"
+	    "frag_heap,frag_growth,touch_secs,hop_ns,packed_ns");
+    for (type = 0; type < 3; type++)
+	fprintf(fp, ",%s_p50,%s_p90,%s_p99,%s_p999,%s_max", names[type], 
+		names[type], names[type], names[type], names[type]);
+    for (j = 0; j < NUM_PERFCTRS; j++)
+	fprintf(fp, ",%s", perfctr_name(j));
+    fprintf(fp, ",host,cpu_model,cpu,governor,cpu_mhz,sched,locked");
+    fprintf(fp, ",run_secs,samples\n");
+
+    for (i = 0; i < n; i++) {
+	stats_t *st = &stats[i];
+	fsecs_stats_t *t = &st->timing;
+
+	fprintf(fp, "%d,%s,%d,%.0f,%.6f", i, tracefiles[i], st->valid, 
+		st->ops, st->util);
+	if (st->twutil >= 0)
+	    fprintf(fp, ",%.6f,%.0f", st->twutil, st->resident);
+	else
+	    fprintf(fp, ",,");
+	fprintf(fp, ",%.9g,%.3f,%.9g,%.9g,%.9g,%d", st->secs,
+		st->secs > 0 ? (st->ops/1e3)/st->secs : 0.0, 
+		t->mad, t->ci_lo, t->ci_hi, t->runs);
+	fprintf(fp, ",%.6f,%.6f,%.6f,%.6f,%.6f,%.6f", st->frag.metadata, 
+		st->frag.padding, st->frag.slack, st->frag.free, 
+		st->frag.heap, st->frag.growth);
+	if (touch)
+	    fprintf(fp, ",%.9g", st->touch_secs);
+	else
+	    fprintf(fp, ",");
+	if (checkpoints)
+	    fprintf(fp, ",%.3f,%.3f", st->hop_ns, st->ref_ns);
+	else
+	    fprintf(fp, ",,");
+	for (type = 0; type < 3; type++) {
+	    latency_t *lat = &st->lat[type];
+
+	    if (latency)
+		fprintf(fp, ",%.1f,%.1f,%.1f,%.1f,%.1f", lat->p50, lat->p90, 
+			lat->p99, lat->p999, lat->max);
+	    else
+		fprintf(fp, ",,,,,");
+	}
+	for (j = 0; j < NUM_PERFCTRS; j++) {
+	    if (counters && st->ctr[j] >= 0)
+		fprintf(fp, ",%.4f", st->ctr[j]);
+	    else
+		fprintf(fp, ",");
+	}
+	fprintf(fp, ",%s,\"%s\",%d,%s,%.0f,%s,%d", env->host, 
+		env->cpu_model, env->cpu, env->governor, env->cur_mhz, 
+		env->sched, env->locked);
+	fprintf(fp, ",");
+	for (j = 0; j < st->num_runs; j++)
+	    fprintf(fp, "%s%.9g", j ? ";" : "", st->run_secs[j]);
+	fprintf(fp, ",");
+	for (j = 0; j < t->runs; j++)
+	    fprintf(fp, "%s%.9g", j ? ";" : "", t->samples[j]);
+	fprintf(fp, "\n");
+    }
+}
+
+/*
+ * compare_results - Compare this run with a baseline saved by -o in JSON
+ *    form, matching traces by file name. A trace regresses if its 
+ *    utilization dropped by more than COMPARE_UTIL_DROP, or if a 
+ *    Mann-Whitney test on the per-process medians (-r) says it got 
+ *    slower at significance level COMPARE_ALPHA, by more than both 
+ *    COMPARE_MIN_SLOWDOWN and the spread of the baseline's medians. The
+ *    samples within one process are not independent enough to test, so
+ *    throughput is left untested without COMPARE_MIN_RUNS medians a side.
+ *    Returns the number of regressions.
+ */
+static int compare_results(char *path, sysenv_t *env, char **tracefiles, 
+			   int n, stats_t *stats)
+{
+    FILE *fp;
+    static char line[64*MAXLINE]; /* too big for the stack */
+    char file[MAXLINE];
+    int i, nb, found, tested, untested = 0, regressions = 0;
+    double base_secs, base_util, base_valid, secs, pval, change, noise;
+    double base_runs[TIMING_MAXPROCS];
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in compare_results", path);
+	unix_error(msg);
+    }
+
+    printf("Comparison with baseline %s:\n", path);
+
+    /* Timings from different conditions aren't directly comparable */
+    if (fgets(line, sizeof(line), fp) != NULL && 
+	strstr(line, "\"env\":") != NULL) {
+	if (json_string(line, "host", file, MAXLINE) && 
+	    strcmp(file, env->host) != 0)
+	    printf("Warning: baseline was taken on host %s\n", file);
+	if (json_string(line, "cpu_model", file, MAXLINE) && 
+	    strcmp(file, env->cpu_model) != 0)
+	    printf("Warning: baseline was taken on a %s\n", file);
+	if (json_string(line, "governor", file, MAXLINE) && 
+	    strcmp(file, env->governor) != 0)
+	    printf("Warning: baseline was taken with the %s governor\n", file);
+    }
+
+    printf("%5s%11s%9s%11s%9s%8s%8s%8s  %s\n", "trace", "base util", 
+	   "util", "base Kops", "Kops", "change", "noise", "p", "verdict");
+    for (i = 0; i < n; i++) {
+	stats_t *st = &stats[i];
+
+	/* Find this trace's line in the baseline */
+	rewind(fp);
+	found = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+	    if (json_string(line, "file", file, MAXLINE) != NULL &&
+		strcmp(file, tracefiles[i]) == 0) {
+		found = 1;
+		break;
+	    }
+	}
+	if (!found || !json_number(line, "secs", &base_secs) ||
+	    !json_number(line, "util", &base_util)) {
+	    printf("%2d%12s\n", i, "not in baseline");
+	    continue;
+	}
+	if (!st->valid) {
+	    /* It only regressed if the baseline ran the trace correctly */
+	    if (json_number(line, "valid", &base_valid) && base_valid == 1) {
+		printf("%2d%12s\n", i, "invalid");
+		regressions++;
+	    }
+	    else
+		printf("%2d%16s\n", i, "still invalid");
+	    continue;
+	}
+
+	/* Test the throughput only on medians from separate processes */
+	nb = json_numbers(line, "run_secs", base_runs, TIMING_MAXPROCS);
+	tested = (nb >= COMPARE_MIN_RUNS && st->num_runs >= COMPARE_MIN_RUNS);
+	secs = st->secs;
+	noise = 0;
+	pval = 1;
+	if (tested) {
+	    base_secs = runs_median(base_runs, nb, &noise);
+	    secs = runs_median(st->run_secs, st->num_runs, NULL);
+	    pval = mann_whitney(base_runs, nb, st->run_secs, st->num_runs);
+	}
+	else
+	    untested++;
+	change = (base_secs > 0 && secs > 0) ? base_secs / secs - 1.0 : 0.0;
+	printf("%2d%13.1f%%%8.1f%%%11.0f%9.0f%7.1f%%", i, 
+	       base_util*100.0, st->util*100.0, 
+	       base_secs > 0 ? (st->ops/1e3)/base_secs : 0.0,
+	       (st->ops/1e3)/secs, change*100.0);
+	if (tested)
+	    printf("%7.1f%%%8.4f  ", noise*100.0, pval);
+	else
+	    printf("%8s%8s  ", "-", "-");
+	if (noise < COMPARE_MIN_SLOWDOWN)
+	    noise = COMPARE_MIN_SLOWDOWN;
+	if (base_util - st->util > COMPARE_UTIL_DROP) {
+	    printf("UTIL REGRESSION\n");
+	    regressions++;
+	}
+	else if (pval < COMPARE_ALPHA && change < -noise) {
+	    printf("THROUGHPUT REGRESSION\n");
+	    regressions++;
+	}
+	else if (pval < COMPARE_ALPHA && change > noise)
+	    printf("faster\n");
+	else
+	    printf("same\n");
+    }
+    fclose(fp);
+
+    if (untested)
+	printf("Throughput untested on %d trace%s; time both sides with "
+	       "-r %d or more\n", untested, untested == 1 ? "" : "s",
+	       COMPARE_MIN_RUNS);
+    if (regressions)
+	printf("%d regression%s against %s\n", regressions, 
+	       regressions == 1 ? "" : "s", path);
+    return regressions;
+}
+
+/*
+ * json_number - Find "key": <number> in line. Returns 0 if not there.
+ */
+static int json_number(char *line, char *key, double *val)
+{
+    char pat[MAXLINE];
+    char *p, *end;
+
+    sprintf(pat, "\"%s\":", key);
+    if ((p = strstr(line, pat)) == NULL)
+	return 0;
+    p += strlen(pat);
+    *val = strtod(p, &end);
+    return end != p;
+}
+
+/*
+ * json_string - Copy the value of "key": "<string>" in line to buf, 
+ *    undoing the escapes that json_write_string adds. Returns NULL if 
+ *    not there, or if it doesn't fit in len bytes.
+ */
+static char *json_string(char *line, char *key, char *buf, int len)
+{
+    char pat[MAXLINE];
+    char *p;
+    int n = 0;
+    unsigned int c;
+
+    sprintf(pat, "\"%s\": \"", key);
+    if ((p = strstr(line, pat)) == NULL)
+	return NULL;
+    for (p += strlen(pat); *p != '"'; p++) {
+	if (*p == '\0' || n >= len - 1)
+	    return NULL;
+	if (*p == '\\') {
+	    p++;
+	    if (*p == 'u' && sscanf(p + 1, "%4x", &c) == 1) {
+		buf[n++] = (char)c;
+		p += 4;
+		continue;
+	    }
+	    if (*p == '\0')
+		return NULL;
+	}
+	buf[n++] = *p;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+/*
+ * json_write_string - Write s to fp as a JSON string, escaping quotes,
+ *    backslashes, and control characters
+ */
+static void json_write_string(FILE *fp, char *s)
+{
+    fputc('"', fp);
+    for (; *s != '\0'; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(fp, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(fp, "\\u%04x", (unsigned char)*s);
+	else
+	    fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * json_numbers - Read up to max numbers from "key": [<numbers>] in line
+ *    into vals. Returns how many were read.
+ */
+static int json_numbers(char *line, char *key, double *vals, int max)
+{
+    char pat[MAXLINE];
+    char *p, *end;
+    int n = 0;
+
+    sprintf(pat, "\"%s\": [", key);
+    if ((p = strstr(line, pat)) == NULL)
+	return 0;
+    p += strlen(pat);
+    while (n < max) {
+	vals[n] = strtod(p, &end);
+	if (end == p)
+	    break;
+	n++;
+	p = end + strspn(end, ", ");
+    }
+    return n;
+}
+
+/*
+ * runs_median - Return the median of the n per-process times in secs,
+ *    and store in *spread (if not NULL) how far the throughput of the
+ *    farthest one is from the median's, as a fraction
+ */
+static double runs_median(double *secs, int n, double *spread)
+{
+    int i;
+    fsecs_stats_t runs;
+
+    runs.runs = n;
+    memcpy(runs.samples, secs, n * sizeof(double));
+    fsecs_summarize(&runs);
+    if (spread != NULL) {
+	*spread = 0;
+	for (i = 0; i < n; i++)
+	    if (secs[i] > 0 && fabs(runs.median / secs[i] - 1) > *spread)
+		*spread = fabs(runs.median / secs[i] - 1);
+    }
+    return runs.median;
+}
+
+/*
+ * mann_whitney - Two-sided Mann-Whitney U test of whether samples a and
+ *    b come from the same distribution. Uses the normal approximation 
+ *    with a correction for ties, and returns the p-value (1 if either
+ *    sample is too small to say anything).
+ */
+static double mann_whitney(double *a, int na, double *b, int nb)
+{
+    int i, j, k, n = na + nb;
+    double u, mu, sigma, z, ties = 0, rank_a = 0;
+    double *all;
+    int *from_a;
+
+    if (na < 3 || nb < 3)
+	return 1.0;
+    if ((all = (double *)malloc(n * sizeof(double))) == NULL ||
+	(from_a = (int *)malloc(n * sizeof(int))) == NULL)
+	unix_error("malloc failed in mann_whitney");
+
+    /* Sort the pooled samples, remembering which came from a */
+    for (i = 0; i < n; i++) {
+	all[i] = (i < na) ? a[i] : b[i - na];
+	from_a[i] = (i < na);
+    }
+    for (i = 1; i < n; i++) {
+	double v = all[i];
+	int f = from_a[i];
+
+	for (j = i - 1; j >= 0 && all[j] > v; j--) {
+	    all[j+1] = all[j];
+	    from_a[j+1] = from_a[j];
+	}
+	all[j+1] = v;
+	from_a[j+1] = f;
+    }
+
+    /* Sum the ranks of a, giving tied values their average rank */
+    for (i = 0; i < n; i = j) {
+	for (j = i + 1; j < n && all[j] == all[i]; j++)
+	    ;
+	for (k = i; k < j; k++)
+	    if (from_a[k])
+		rank_a += (i + 1 + j) / 2.0;
+	ties += (double)(j - i) * (j - i) * (j - i) - (j - i);
+    }
+    free(all);
+    free(from_a);
+
+    u = rank_a - na * (na + 1) / 2.0;
+    mu = na * (double)nb / 2.0;
+    sigma = sqrt(na * (double)nb / 12.0 * ((n + 1) - ties / (n * (n - 1.0))));
+    if (sigma == 0)
+	return 1.0;
+    z = (fabs(u - mu) - 0.5) / sigma;  /* with continuity correction */
+    if (z < 0)
+	z = 0;
+    return erfc(z / sqrt(2.0));
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+
+/*
+ * printresults - prints a performance summary for some malloc package
+ */
+static void printresults(int n, stats_t *stats) 
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+    double util = 0;
+
+    /* Print the individual results for each trace */
+    printf("%5s%7s %5s%8s%10s%6s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+		   i,
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].ops,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	}
+	else {
+	    printf("%2d%10s%6s%8s%10s%6s\n", 
+		   i,
+		   "no",
+		   "-",
+		   "-",
+		   "-",
+		   "-");
+	}
+    }
+
+    /* Print the aggregate results for the set of traces */
+    if (errors == 0) {
+	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	       "Total       ",
+	       (util/n)*100.0,
+	       ops, 
+	       secs,
+	       (ops/1e3)/secs);
+    }
+    else {
+	printf("%12s%6s%8s%10s%6s\n", 
+	       "Total       ",
+	       "-", 
+	       "-", 
+	       "-", 
+	       "-");
+    }
+
+}
+
+/*
+ * printutil - prints, for each trace, the utilization of the brk high 
+ *     water mark next to the time-weighted utilization of resident 
+ *     memory and the mean resident heap size (in KB), as sampled by -U
+ */
+static void printutil(int n, stats_t *stats)
+{
+    int i, measured = 1;
+    double util = 0, twutil = 0;
+
+    printf("%5s%7s%8s%10s\n", "trace", "util", "twutil", "resident");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%10s\n", i, "-");
+	    continue;
+	}
+	if (stats[i].twutil < 0) {
+	    printf("%2d%9.0f%%%8s%10s\n", i, stats[i].util*100.0, "-", "-");
+	    measured = 0;
+	    continue;
+	}
+	printf("%2d%9.0f%%%7.0f%%%10.0f\n", i, stats[i].util*100.0, 
+	       stats[i].twutil*100.0, stats[i].resident/1024);
+	util += stats[i].util;
+	twutil += stats[i].twutil;
+    }
+    if (errors == 0 && measured)
+	printf("%5s%6.0f%%%7.0f%%\n", "Total", (util/n)*100.0, 
+	       (twutil/n)*100.0);
+}
+
+/*
+ * printfrag - prints, for each trace, how the heap at its peak splits 
+ *     into payload (the utilization) and each cause of lost space, then
+ *     how the free bytes split by the size of their block
+ */
+static void printfrag(int n, stats_t *stats)
+{
+    int i, j;
+    static size_t limits[FRAG_BUCKETS] = FRAG_BUCKET_LIMITS;
+    char label[16];
+
+    printf("%5s%6s%6s%6s%6s%6s%6s%6s\n", "trace", "util", "meta", "pad", 
+	   "slack", "free", "heap", "grow");
+    for (i=0; i < n; i++) {
+	frag_t *f = &stats[i].frag;
+
+	if (!stats[i].valid) {
+	    printf("%2d%9s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%9.1f%6.1f%6.1f%6.1f%6.1f%6.1f%6.1f\n", i, 
+	       stats[i].util*100, f->metadata*100, f->padding*100, 
+	       f->slack*100, f->free*100, f->heap*100, f->growth*100);
+    }
+
+    printf("\nFree bytes at the peak by block size (%% of heap):\n");
+    printf("%5s", "trace");
+    for (j = 0; j < FRAG_BUCKETS; j++) {
+	if (j < FRAG_BUCKETS-1)
+	    sprintf(label, "<%lu", (unsigned long)limits[j]);
+	else
+	    sprintf(label, ">=%lu", (unsigned long)limits[j-1]);
+	printf("%8s", label);
+    }
+    printf("\n");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%11s\n", i, "-");
+	    continue;
+	}
+	printf("%2d   ", i);
+	for (j = 0; j < FRAG_BUCKETS; j++)
+	    printf("%8.1f", stats[i].frag.free_bucket[j]*100);
+	printf("\n");
+    }
+}
+
+/*
+ * printmmstats - prints, for each trace, the counts mm_stats() gathered
+ *     over one replay: requests, the share of blocks placed without 
+ *     growing the heap, heap extensions, coalesce calls by case, and 
+ *     the peak heap size (in KB)
+ */
+static void printmmstats(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%8s%8s%8s%7s%6s%8s%8s%8s%8s%8s\n", "trace", "malloc", 
+	   "free", "realloc", "fit%", "ext", "coal1", "coal2", "coal3", 
+	   "coal4", "peakKB");
+    for (i=0; i < n; i++) {
+	struct mm_stats *mm = &stats[i].mm;
+	unsigned long placed = mm->fit_hits + mm->fit_misses;
+
+	if (!stats[i].valid) {
+	    printf("%2d%11s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%11lu%8lu%8lu%7.1f%6lu%8lu%8lu%8lu%8lu%8lu\n", i, 
+	       mm->mallocs, mm->frees, mm->reallocs, 
+	       placed ? 100.0 * mm->fit_hits / placed : 0.0, 
+	       mm->extend_heaps, mm->coalesces[0], mm->coalesces[1], 
+	       mm->coalesces[2], mm->coalesces[3], mm->peak_heap_bytes/1024);
+    }
+}
+
+/*
+ * printheapprof - prints, for each trace, the live payload at its peak
+ *     next to the heap profiler's estimate of it (both in KB)
+ */
+static void printheapprof(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%8s\n", "trace", "liveKB", "estKB", "error");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].peak_live <= 0) {
+	    printf("%2d%13s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%13.0f%10.0f%7.1f%%\n", i, stats[i].peak_live/1024, 
+	       stats[i].prof_live/1024, 
+	       100 * (stats[i].prof_live - stats[i].peak_live) / 
+	       stats[i].peak_live);
+    }
+}
+
+/*
+ * printfitstats - prints, for each trace, how many blocks find_fit 
+ *     probed per search, how often it wrapped around to the start of the
+ *     heap or failed, and then the share of searches by number of probes
+ */
+static void printfitstats(int n, stats_t *stats)
+{
+    int i, j;
+    char label[16];
+
+    printf("%5s%9s%8s%8s%7s%7s\n", "trace", "searches", "mean", "max", 
+	   "wrap%", "fail%");
+    for (i=0; i < n; i++) {
+	struct mm_fitstats *fit = &stats[i].fit;
+
+	if (!stats[i].valid || fit->searches == 0) {
+	    printf("%2d%12s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%12lu%8.1f%8lu%7.1f%7.1f\n", i, fit->searches, 
+	       (double)fit->probes / fit->searches, fit->max_probes, 
+	       100.0 * fit->wraps / fit->searches, 
+	       100.0 * fit->failures / fit->searches);
+    }
+
+    printf("\nSearches by blocks probed (%%):\n");
+    printf("%5s", "trace");
+    for (j = 0; j < MM_FIT_BUCKETS; j++) {
+	if (j == 0)
+	    sprintf(label, "0");
+	else if (j == 1)
+	    sprintf(label, "1");
+	else if (j < MM_FIT_BUCKETS-1)
+	    sprintf(label, "<%d", 1 << j);
+	else
+	    sprintf(label, ">=%d", 1 << (j-1));
+	printf("%6s", label);
+    }
+    printf("\n");
+    for (i=0; i < n; i++) {
+	struct mm_fitstats *fit = &stats[i].fit;
+
+	if (!stats[i].valid || fit->searches == 0) {
+	    printf("%2d%9s\n", i, "-");
+	    continue;
+	}
+	printf("%2d   ", i);
+	for (j = 0; j < MM_FIT_BUCKETS; j++)
+	    printf("%6.1f", 100.0 * fit->probe_hist[j] / fit->searches);
+	printf("\n");
+    }
+}
+
+/*
+ * printprofile - prints, for each trace, the share of mm's profiled time
+ *     spent in each phase and the total (in usecs). The cost of reading
+ *     the tick counter is taken out of each timed interval.
+ */
+static void printprofile(int n, stats_t *stats)
+{
+    int i, j;
+    double ovhd = ticks_ovhd();
+    double us_per_tick = 1.0 / ticks_mhz();
+    double ticks[MM_PHASES], total;
+
+    printf("%5s%8s%8s%8s%9s%8s%8s%10s\n", "trace", "adjust", "fit", 
+	   "place", "coalesce", "extend", "copy", "usecs");
+    for (i=0; i < n; i++) {
+	struct mm_profile *prof = &stats[i].prof;
+
+	if (!stats[i].valid) {
+	    printf("%2d%11s\n", i, "-");
+	    continue;
+	}
+	total = 0;
+	for (j = 0; j < MM_PHASES; j++) {
+	    ticks[j] = prof->ticks[j] - ovhd * prof->calls[j];
+	    ticks[j] = (ticks[j] > 0) ? ticks[j] : 0;
+	    total += ticks[j];
+	}
+	if (total == 0) {
+	    printf("%2d%11s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%11.1f%8.1f%8.1f%9.1f%8.1f%8.1f%10.0f\n", i, 
+	       100 * ticks[MM_PHASE_ADJUST] / total, 
+	       100 * ticks[MM_PHASE_FIT] / total, 
+	       100 * ticks[MM_PHASE_PLACE] / total, 
+	       100 * ticks[MM_PHASE_COALESCE] / total, 
+	       100 * ticks[MM_PHASE_EXTEND] / total, 
+	       100 * ticks[MM_PHASE_COPY] / total, total * us_per_tick);
+    }
+}
+
+/*
+ * printlatency - prints the request latency percentiles (in ns) of 
+ *     each request type for each trace
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i, type;
+    static char *names[3];
+
+    names[ALLOC] = "malloc";
+    names[FREE] = "free";
+    names[REALLOC] = "realloc";
+
+    printf("%5s%9s%8s%8s%8s%8s%8s%10s\n",
+	   "trace", "request", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%12s\n", i, "-");
+	    continue;
+	}
+	for (type = 0; type < 3; type++) {
+	    latency_t *lat = &stats[i].lat[type];
+
+	    if (lat->count == 0)
+		continue;
+	    printf("%2d%12s%8.0f%8.0f%8.0f%8.0f%8.0f%10.0f\n",
+		   i, names[type], lat->count, lat->p50, lat->p90, 
+		   lat->p99, lat->p999, lat->max);
+	}
+    }
+}
+
+/*
+ * printtiming - prints the median, MAD, and 95% confidence interval of
+ *     the timed runs behind each trace's secs, in microseconds. The runs
+ *     are all in this process, so the CI is within-process noise only.
+ */
+static void printtiming(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%6s%12s%10s%12s%12s%7s\n", 
+	   "trace", "runs", "median", "MAD", "CI low", "CI high", "+-%");
+    for (i=0; i < n; i++) {
+	fsecs_stats_t *t = &stats[i].timing;
+
+	if (!stats[i].valid || t->runs == 0) {
+	    printf("%2d%9s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%9d%12.1f%10.1f%12.1f%12.1f%7.2f\n", 
+	       i, t->runs, t->median*1e6, t->mad*1e6, 
+	       t->ci_lo*1e6, t->ci_hi*1e6, 
+	       100.0 * (t->ci_hi - t->ci_lo) / (2 * t->median));
+    }
+    printf("The CI is within-process only; -r gives run-to-run noise.\n");
+}
+
+/*
+ * printtouch - prints the throughput of each trace with and without 
+ *     the payloads touched, and the share of the touching run's time
+ *     that the touching added
+ */
+static void printtouch(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%8s\n", "trace", "Kops", "touched", "cost");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].touch_secs <= 0) {
+	    printf("%2d%13s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%13.0f%10.0f%7.1f%%\n", i, 
+	       (stats[i].ops/1e3)/stats[i].secs,
+	       (stats[i].ops/1e3)/stats[i].touch_secs,
+	       100.0 * (1.0 - stats[i].secs / stats[i].touch_secs));
+    }
+}
+
+/*
+ * printlocality - prints, for each trace, the mean time per hop of a 
+ *     cold walk through the live blocks, that of the same walk over the
+ *     blocks packed end to end, and their ratio as a score out of 100.
+ *     A heap can walk faster than the packed blocks (the prefetchers may
+ *     like its spacing better), but it can't score more than 100.
+ */
+static void printlocality(int n, stats_t *stats)
+{
+    int i;
+    double ratio, score = 0;
+    int scored = 0;
+
+    printf("%5s%10s%10s%8s\n", "trace", "ns/hop", "packed", "score");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].hop_ns <= 0) {
+	    printf("%2d%13s\n", i, "-");
+	    continue;
+	}
+	ratio = stats[i].ref_ns / stats[i].hop_ns;
+	if (ratio > 1)
+	    ratio = 1;
+	printf("%2d%13.2f%10.2f%8.0f\n", i, stats[i].hop_ns, 
+	       stats[i].ref_ns, 100.0 * ratio);
+	score += ratio;
+	scored++;
+    }
+    if (scored)
+	printf("%12s%21.0f\n", "Mean score  ", 100.0 * score / scored);
+}
+
+/*
+ * printcounters - prints the hardware events per request for each trace
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, j;
+
+    printf("%5s", "trace");
+    for (j = 0; j < NUM_PERFCTRS; j++)
+	printf("%10s", perfctr_name(j));
+    printf("%6s\n", "IPC");
+    for (i=0; i < n; i++) {
+	double *ctr = stats[i].ctr;
+
+	printf("%2d   ", i);
+	for (j = 0; j < NUM_PERFCTRS; j++) {
+	    if (stats[i].valid && ctr[j] >= 0)
+		printf("%10.2f", ctr[j]);
+	    else
+		printf("%10s", "-");
+	}
+	if (stats[i].valid && ctr[PERFCTR_INSTRUCTIONS] >= 0 && 
+	    ctr[PERFCTR_CYCLES] > 0)
+	    printf("%6.2f\n", ctr[PERFCTR_INSTRUCTIONS]/ctr[PERFCTR_CYCLES]);
+	else
+	    printf("%6s\n", "-");
+    }
 }
 
 /* 
@@ -974,13 +4265,56 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValBGILMPR] [-f <file>] [-t <dir>] [-j <n>] [-k <n>] [-T <n>]\n");
+    fprintf(stderr, "               [-o <results>] [-c <baseline>] [-C <cpu>] [-w <touch>]\n");
+    fprintf(stderr, "               [-s <series> [-S <n>]] [-H <bytes>] [-E <log>]\n");
+    fprintf(stderr, "               [-d <prefix>] [-X <n>] [-U <n>] [-r <n>]\n");
     fprintf(stderr, "Options\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-c <file>  Compare with a JSON baseline (--compare);\n");
+    fprintf(stderr, "\t           exit with status 2 on a regression. "
+	    "Throughput is only\n");
+    fprintf(stderr, "\t           compared if both sides ran with -r %d "
+	    "or more.\n", COMPARE_MIN_RUNS);
+    fprintf(stderr, "\t-B         Time mm realloc of large blocks with "
+	    "each copy engine (--copy).\n");
+    fprintf(stderr, "\t-C <cpu>   Pin the driver to CPU <cpu> (--cpu).\n");
+    fprintf(stderr, "\t-d <pre>   Write each trace's peak heap to "
+	    "<pre>-<n>.snap (--snapshot).\n");
+    fprintf(stderr, "\t-E <file>  Write the mm event log to <file> "
+	    "(--event-log).\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as the trace file (.rep or "
+	    "event log).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-G         Time mm with guarded sampling at "
+	    "several rates (--guard).\n");
+    fprintf(stderr, "\t-H <bytes> Sample the mm heap every <bytes> "
+	    "(--heap-profile).\n");
+    fprintf(stderr, "\t-I         Check that mm keeps every payload intact, "
+	    "by hash (--hash).\n");
+    fprintf(stderr, "\t-j <n>     Evaluate traces in <n> pinned workers.\n");
+    fprintf(stderr, "\t-k <n>     Time walks over live blocks at <n> points "
+	    "(--locality).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print per-request latency percentiles.\n");
+    fprintf(stderr, "\t-o <file>  Save results as JSON, or CSV if <file> "
+	    "ends in .csv (--results).\n");
+    fprintf(stderr, "\t-M         Lock all memory into RAM (--mlock).\n");
+    fprintf(stderr, "\t-P         Print hardware events per request.\n");
+    fprintf(stderr, "\t-r <n>     Time the traces in <n> processes, "
+	    "for -c (--runs).\n");
+    fprintf(stderr, "\t-R         Raise scheduling priority (--realtime).\n");
+    fprintf(stderr, "\t-s <file>  Write a CSV time series of the heap (--series).\n");
+    fprintf(stderr, "\t-S <n>     Sample the heap every <n> requests for -s.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Measure throughput on 1..<n> threads.\n");
+    fprintf(stderr, "\t-U <n>     Measure time-weighted utilization, "
+	    "sampling every <n> requests\n");
+    fprintf(stderr, "\t           (--twutil; not with -M).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-X <n>     Check the heap at every request, all of it "
+	    "every <n> (--check).\n");
+    fprintf(stderr, "\t-w <touch> Also time with payloads touched (--touch):\n");
+    fprintf(stderr, "\t           line or full, optionally with ,read.\n");
 }
@@ -17,21 +17,35 @@
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
+static char *mem_peak_brk;   /* highest brk since the heap was last reset */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static unsigned char *mem_pagevec; /* mincore() results, one per page */
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
+    /* 
+     * map the storage we will use to model the available VM; it is
+     * page-aligned so that pages can be released and counted. A spare
+     * MAX_HEAP bytes above it are mapped along with it (see mem_spare).
+     */
+    mem_start_brk = (char *)mmap(NULL, 2*MAX_HEAP, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+    mem_pagevec = (unsigned char *)malloc(MAX_HEAP / mem_pagesize() + 1);
+    if (mem_pagevec == NULL) {
 	fprintf(stderr, "mem_init_vm: malloc error\n");
 	exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak_brk = mem_start_brk;
 }
 
 /* 
@@ -39,7 +53,8 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, 2*MAX_HEAP);
+    free(mem_pagevec);
 }
 
 /*
@@ -48,26 +63,104 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr trims the heap instead, and the whole pages above 
+ *    the new brk are handed back to the system. The trim succeeds even
+ *    if they can't be (pages locked by -M just stay resident).
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ((mem_brk + incr) > mem_max_addr) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+    if ((mem_brk + incr) < mem_start_brk) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Trimmed below the heap...\n");
+	return (void *)-1;
+    }
     mem_brk += incr;
+    if (mem_brk > mem_peak_brk)
+	mem_peak_brk = mem_brk;
+    if (incr < 0)
+	(void)mem_release(mem_brk, -incr);
     return (void *)old_brk;
 }
 
+/*
+ * mem_release - tell the system that the heap bytes [addr, addr+len) 
+ *    are no longer needed, like madvise(MADV_DONTNEED). Only the whole
+ *    pages in the range are released; they read as zero and become 
+ *    resident again once touched. Returns 0, or -1 if the range isn't
+ *    inside the heap.
+ */
+int mem_release(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *lo = (char *)addr;
+    char *hi = lo + len;
+
+    if (lo < mem_start_brk || hi > mem_max_addr || hi < lo) {
+	errno = EINVAL;
+	return -1;
+    }
+    /* round lo up and hi down to page boundaries */
+    lo += (pagesize - (lo - mem_start_brk) % pagesize) % pagesize;
+    hi -= (hi - mem_start_brk) % pagesize;
+    if (hi <= lo)
+	return 0;
+    return madvise(lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_discard - release every page of the heap storage, so that 
+ *    mem_resident() counts only the pages touched from now on. Returns
+ *    0, or -1 with errno set if the pages can't be released (madvise()
+ *    fails with EINVAL on pages locked by mlockall(), for instance).
+ */
+int mem_discard(void)
+{
+    return madvise(mem_start_brk, MAX_HEAP, MADV_DONTNEED);
+}
+
+/*
+ * mem_resident - return the number of bytes of the heap that are 
+ *    resident in memory, counted in whole pages
+ */
+size_t mem_resident(void)
+{
+    size_t i, npages, pagesize = mem_pagesize();
+    size_t resident = 0;
+
+    npages = (mem_brk - mem_start_brk + pagesize - 1) / pagesize;
+    if (npages == 0)
+	return 0;
+    if (mincore(mem_start_brk, npages * pagesize, mem_pagevec) < 0)
+	return mem_heapsize();  /* can't tell; assume it all is */
+    for (i = 0; i < npages; i++)
+	resident += mem_pagevec[i] & 1;
+    return resident * pagesize;
+}
+
+/*
+ * mem_spare - return the MAX_HEAP bytes mapped just above the largest
+ *    legal heap address, which the heap never grows into. Data laid out
+ *    there sits in the same mapping as the heap, with the same kind of
+ *    pages.
+ */
+void *mem_spare(void)
+{
+    return (void *)mem_max_addr;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +185,15 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest the heap has been, in bytes,
+ *    since it was last reset
+ */
+size_t mem_peak_heapsize() 
+{
+    return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -3,9 +3,14 @@
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+int mem_release(void *addr, size_t len);
+int mem_discard(void);
 void mem_reset_brk(void); 
+void *mem_spare(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_resident(void);
 size_t mem_pagesize(void);
 
@@ -18,9 +18,27 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "heapsnap.h"
+#include "copy.h"
+#ifdef MM_PROFILE
+#include "clock.h"
+#endif
+#include <limits.h>
+#ifndef MM_NOHEAPPROF
+#include "heapprof.h"
+#endif
+#ifdef MM_EVENTLOG
+#include "evlog.h"
+#endif
+#ifndef MM_NOGUARD
+#include "guard.h"
+#endif
 
 /* single word (4) or double word (8) alignment */
 #define ALIGNMENT 8
@@ -43,6 +61,8 @@
 // read the size and allocated fields from address p
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+// Header bit of an allocated block that the heap profiler sampled
+#define SAMPLED 0x2
 // Address of block ptr bp header and footer computer
 #define HDRP(bp) ((char *)(bp) - WSIZE)
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
@@ -50,25 +70,142 @@
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
-// Degbugging From Zachary Leeper's TA Session
-// Calls deleted in actual code as TA said it would reduce optimization in Piazza
-#ifdef DEBUG
-#define CHECKHEAP mm_check()
-#define INC_NUM_FREEBLOCKS num_freeblocks++
-#define DEC_NUM_FREEBLOCKS num_freeblocks--
+// Heap checking for mm_check_every. While it is on, every request checks
+// the blocks around the ones it changed (bp and other, either of which
+// may be NULL), and every check_every-th request
+// sweeps the whole heap as well. A failed check aborts. While it is off a
+// request pays for one test of check_every.
+static int check_every; // requests between full sweeps, or 0 if off
+static int check_countdown; // requests until the next full sweep
+static int check_request(void *bp, void *other);
+#define CHECK(bp, other) do { \
+    if(check_every && check_request(bp, other) < 0) \
+        abort(); \
+} while(0)
+
+// Thread safety. Building with -DMM_THREADS serializes the public entry
+// points on a single heap lock; otherwise the lock compiles away.
+#ifdef MM_THREADS
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK pthread_mutex_lock(&heap_lock)
+#define UNLOCK pthread_mutex_unlock(&heap_lock)
+#else
+#define LOCK
+#define UNLOCK
+#endif
+
+// Statistics for mm_stats. Counts are only made with the heap lock held,
+// so a count costs one increment. Building with -DMM_NOSTATS compiles the
+// counting out.
+static struct mm_stats stats;
+#ifdef MM_NOSTATS
+#define STAT_ADD(field, n)
+#else
+#define STAT_ADD(field, n) (stats.field += (n))
+#endif
+#define STAT_INC(field) STAT_ADD(field, 1)
+
+// find_fit search statistics for mm_fitstats. They cost a counter per
+// block visited, so they are only kept when built with -DMM_FITSTATS.
+#ifdef MM_FITSTATS
+static struct mm_fitstats fitstats;
+static void fit_record(unsigned long probes, int wrapped, int failed);
+#define FIT_COUNT(stmt) stmt
+#else
+#define FIT_COUNT(stmt)
+#endif
+
+// Per-phase tick profile for mm_profile. PROFILE_START(t) reads the tick
+// counter into a new variable t, and PROFILE_STOP(t, phase) charges the
+// ticks since then to phase. Both compile to nothing without -DMM_PROFILE.
+#ifdef MM_PROFILE
+static struct mm_profile profile;
+#define PROFILE_START(t) unsigned long long t = read_ticks()
+#define PROFILE_STOP(t, phase) \
+    (profile.ticks[phase] += read_ticks() - (t), profile.calls[phase]++)
+#else
+#define PROFILE_START(t)
+#define PROFILE_STOP(t, phase)
+#endif
+
+// Heap profiler sampling. Every allocation counts its size down from
+// sample_countdown; only when that runs out is the block flagged SAMPLED
+// in its header and handed to heapprof.c. Until mm_heapprof_start the
+// countdown is too large to run out. -DMM_NOHEAPPROF compiles it out.
+#ifndef MM_NOHEAPPROF
+static long sample_countdown = LONG_MAX; // bytes until the next sample
+static void sample_block(void *bp, size_t size);
+#define SAMPLE(bp, size) do { \
+    if((sample_countdown -= (long)(size)) < 0 && (bp) != NULL) \
+        sample_block(bp, size); \
+} while(0)
+#define UNSAMPLE(bp) do { \
+    if(GET(HDRP(bp)) & SAMPLED) \
+        heapprof_forget(bp); \
+} while(0)
 #else
-#define CHECKHEAP
-#define INC_NUM_FREEBLOCKS
-#define DEC_NUM_FREEBLOCKS
+#define SAMPLE(bp, size)
+#define UNSAMPLE(bp)
 #endif
 
+// Guarded sampling for mm_guard_start. Every allocation counts down
+// guard_countdown; only when that runs out does GUARD_ALLOC try to place
+// the block in the guarded pool of guard.c instead of the heap. Until
+// mm_guard_start the countdown is too large to run out, so a request pays
+// one decrement and test, and a free one range check (GUARDED). Building
+// with -DMM_NOGUARD compiles it out.
+#ifndef MM_NOGUARD
+static long guard_countdown = LONG_MAX; // allocations until the next sample
+static void *guard_block(size_t size);
+#define GUARD_ALLOC(bp, size) \
+    (--guard_countdown <= 0 && ((bp) = guard_block(size)) != NULL)
+#define GUARDED(p) guard_owns(p)
+#else
+#define GUARD_ALLOC(bp, size) 0
+#define GUARDED(p) 0
+#define guard_free(p)
+#define guard_size(p) 0
+#endif
+
+// Event log for mm_eventlog_dump. Every request is logged with its result
+// in a ring buffer of the calling thread (see evlog.c), so that the last
+// requests before an incident can be replayed. Only kept when built with
+// -DMM_EVENTLOG.
+#ifdef MM_EVENTLOG
+#define EVLOG(op, ptr, old, size) evlog_add(op, ptr, old, size)
+#else
+#define EVLOG(op, ptr, old, size)
+#endif
+
+// Heap snapshots. mm_heap_snapshot buffers this many block words between
+// write()s, on the stack, so that it allocates nothing.
+#define SNAP_WORDS 1024
+typedef struct {
+    int fd;
+    int len; // words in buf
+    int err; // set if a write failed
+    uint32_t buf[SNAP_WORDS];
+} snapshot_t;
+
 // Global Variables
 static char *heap_listp = 0; // First block pointer
 static char *finder; // next fit block pointer
+static unsigned long peak_heap; // largest heap size, for mm_stats
+#ifndef MM_NOSTATS
+static int size_class(size_t size);
+#endif
+static void *malloc_block(size_t size);
+static void *free_block(void *ptr);
 static void *extend_heap(size_t words);
 static void *coalesce(void *bp);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
+static int snapshot_block(void *bp, size_t size, int alloc, void *ctx);
+static int check_heap(void);
+static int check_near(void *bp);
+static int check_block(void *bp);
+static int check_failed(void *bp, const char *problem);
+static void snapshot_put(snapshot_t *snap, uint32_t word);
 
 // Header Node. Contains a single field which is the packed size 
 // and is allocated
@@ -170,6 +307,23 @@ int mm_init(void)
     PUT(heap_listp + (3 * WSIZE), PACK(0,1));
     heap_listp += (2 * WSIZE);
     finder = heap_listp;
+    // A new heap starts new statistics
+    memset(&stats, 0, sizeof(stats));
+    peak_heap = 0;
+    FIT_COUNT(memset(&fitstats, 0, sizeof(fitstats)));
+    check_countdown = check_every;
+#ifdef MM_PROFILE
+    memset(&profile, 0, sizeof(profile));
+#endif
+#ifndef MM_NOHEAPPROF
+    heapprof_clear();
+#endif
+#ifndef MM_NOGUARD
+    guard_clear();
+#endif
+#ifdef MM_EVENTLOG
+    evlog_clear();
+#endif
     // Empty heap with free blocks of CHUNKSIZE byted is extended
     if(extend_heap(CHUNKSIZE/WSIZE) == NULL){
         return -1;
@@ -177,12 +331,47 @@ int mm_init(void)
     return 0;
 }
 
+/*
+ * mm_is_threadsafe - Returns nonzero if the package was built with MM_THREADS
+ * and may be called concurrently from several threads.
+ */
+int mm_is_threadsafe(void)
+{
+#ifdef MM_THREADS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 /* 
  * mm_malloc - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
  *     Method derived from the Computer Systems Textbook
  */
 void *mm_malloc(size_t size)
+{
+    void *bp;
+    LOCK;
+    STAT_INC(mallocs);
+    STAT_INC(class_mallocs[size_class(size)]);
+    if(GUARD_ALLOC(bp, size)){
+        EVLOG(EV_MALLOC, bp, NULL, size);
+        UNLOCK;
+        return bp;
+    }
+    bp = malloc_block(size);
+    SAMPLE(bp, size);
+    EVLOG(EV_MALLOC, bp, NULL, size);
+    CHECK(bp, NULL);
+    UNLOCK;
+    return bp;
+}
+
+/*
+    Helper: does the work of mm_malloc. The caller holds the heap lock.
+*/
+static void *malloc_block(size_t size)
 {
    size_t asize;
    size_t extendsize;
@@ -190,23 +379,34 @@ void *mm_malloc(size_t size)
    if(size == 0){
        return NULL;
    }
+   PROFILE_START(t_adjust);
    // The block size is adjusted according to the required allignement
    if(size <= DSIZE){
        asize = 2 * DSIZE;
    } else{
        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
    }
+   PROFILE_STOP(t_adjust, MM_PHASE_ADJUST);
    // trying to find a fit by searching the free list
-   if((bp = find_fit(asize)) != NULL){
+   PROFILE_START(t_fit);
+   bp = find_fit(asize);
+   PROFILE_STOP(t_fit, MM_PHASE_FIT);
+   if(bp != NULL){
+       STAT_INC(fit_hits);
+       PROFILE_START(t_place);
        place(bp, asize);
+       PROFILE_STOP(t_place, MM_PHASE_PLACE);
        return bp;
    }
+   STAT_INC(fit_misses);
    // If the fit was not found then ore memory requested and block placed
    extendsize = MAX(asize, CHUNKSIZE);
    if((bp = extend_heap(extendsize/WSIZE)) == NULL){
        return NULL;
    }
+   PROFILE_START(t_place2);
    place(bp, asize);
+   PROFILE_STOP(t_place2, MM_PHASE_PLACE);
    return bp;
 }
 
@@ -220,21 +420,46 @@ void *mm_malloc(size_t size)
 static void *find_fit(size_t asize){
     char * temp = finder;
     void *bp;
+    FIT_COUNT(unsigned long probes = 0);
     // Next Fit Search Implementation
     // Searches for fit starting at the most recent last allocated block (where the previous search finished)
     for(finder = finder; GET_SIZE(HDRP(finder)); finder = NEXT_BLKP(finder)){
+        FIT_COUNT(probes++);
         if(!GET_ALLOC(HDRP(finder)) && (asize <= GET_SIZE(HDRP(finder)))){
+            FIT_COUNT(fit_record(probes, 0, 0));
             return finder;
         }
     }
     // Searches for fit from starting until the previous search;
     for(bp = heap_listp; bp < temp; bp = NEXT_BLKP(bp)){
+        FIT_COUNT(probes++);
         if(!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp)))){
+            FIT_COUNT(fit_record(probes, 1, 0));
             return bp;
         }
     }
+    FIT_COUNT(fit_record(probes, 1, 1));
     return NULL;
 }
+
+#ifdef MM_FITSTATS
+/*
+    Helper: adds one find_fit search that visited probes blocks to the
+    search statistics
+*/
+static void fit_record(unsigned long probes, int wrapped, int failed){
+    int bucket = 0;
+    while(probes >> bucket && bucket < MM_FIT_BUCKETS - 1){
+        bucket++;
+    }
+    fitstats.searches++;
+    fitstats.probes += probes;
+    fitstats.max_probes = MAX(fitstats.max_probes, probes);
+    fitstats.wraps += wrapped;
+    fitstats.failures += failed;
+    fitstats.probe_hist[bucket]++;
+}
+#endif
 /*
     Helper: Function from the Computer Systems Textbook
     If the remainder of the block after splitting is greater than or equal to the minimum block size
@@ -245,12 +470,14 @@ static void place(void *bp, size_t asize){
     if((csize - asize) >= (2 * DSIZE)){
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
+        STAT_ADD(live_bytes, asize - DSIZE);
         bp = NEXT_BLKP(bp);
         PUT(HDRP(bp), PACK(csize - asize, 0));
         PUT(FTRP(bp), PACK(csize - asize, 0));
     } else{
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
+        STAT_ADD(live_bytes, csize - DSIZE);
     }
 }
 /*
@@ -261,17 +488,26 @@ static void place(void *bp, size_t asize){
 static void *extend_heap(size_t words){
     char *bp;
     size_t size;
+    PROFILE_START(t_extend);
     // Allocate even number of words to maintain alignment
     size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
     if ((long)(bp = mem_sbrk(size)) == -1){
         return NULL;
     }
+    STAT_INC(extend_heaps);
+    if(mem_heapsize() > peak_heap){
+        peak_heap = mem_heapsize();
+    }
     // Free block header and footer and epilogue header are initialized
     PUT(HDRP(bp), PACK(size, 0)); // Free block header
     PUT(FTRP(bp), PACK(size, 0)); // Free block footer
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // New epilogue header
+    PROFILE_STOP(t_extend, MM_PHASE_EXTEND);
     // Coalesce if previous block free
-    return coalesce(bp);
+    PROFILE_START(t_coalesce);
+    bp = coalesce(bp);
+    PROFILE_STOP(t_coalesce, MM_PHASE_COALESCE);
+    return bp;
 }
 
 /*
@@ -282,10 +518,36 @@ static void *extend_heap(size_t words){
  */
 void mm_free(void *ptr)
 {
-    size_t size = GET_SIZE(HDRP(ptr));
+    void *bp;
+    LOCK;
+    STAT_INC(frees);
+    bp = free_block(ptr);
+    EVLOG(EV_FREE, ptr, NULL, 0);
+    CHECK(bp, NULL);
+    UNLOCK;
+}
+
+/*
+    Helper: does the work of mm_free. The caller holds the heap lock.
+    Returns the free block that ptr ended up in after coalescing, or NULL
+    if ptr was in the guarded pool.
+*/
+static void *free_block(void *ptr)
+{
+    size_t size;
+    if(GUARDED(ptr)){
+        guard_free(ptr);
+        return NULL;
+    }
+    size = GET_SIZE(HDRP(ptr));
+    STAT_ADD(live_bytes, -(size - DSIZE));
+    UNSAMPLE(ptr);
     PUT(HDRP(ptr), PACK(size, 0));
     PUT(FTRP(ptr), PACK(size, 0));
-    coalesce(ptr);
+    PROFILE_START(t_coalesce);
+    ptr = coalesce(ptr);
+    PROFILE_STOP(t_coalesce, MM_PHASE_COALESCE);
+    return ptr;
 }
 
 /*
@@ -300,11 +562,13 @@ static void *coalesce(void *bp){
     // Case 1
     // Next and prev allocated and block being freed in the middle
     if(prev_alloc && next_alloc){
+        STAT_INC(coalesces[0]);
         return bp;
     }
     // Case 2
     // next is free and previous is allocated
     else if(prev_alloc && !next_alloc){
+        STAT_INC(coalesces[1]);
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
@@ -312,6 +576,7 @@ static void *coalesce(void *bp){
     // Case 3
     // Previous is free and the next block is allocated
     else if(!prev_alloc && next_alloc){
+        STAT_INC(coalesces[2]);
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         PUT(FTRP(bp), PACK(size, 0));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
@@ -319,6 +584,7 @@ static void *coalesce(void *bp){
     // Case 4
     // Both previous and next are free
     } else{
+        STAT_INC(coalesces[3]);
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
@@ -343,99 +609,534 @@ void *mm_realloc(void *ptr, size_t size)
     void *old = ptr;
     void *newp;
     size_t copy;
+    LOCK;
+    STAT_INC(reallocs);
     // Gets new ptr block and size of payload calculated
-    newp = mm_malloc(size);
+    newp = malloc_block(size);
     if (newp == NULL){
+      EVLOG(EV_REALLOC, NULL, old, size);
+      CHECK(NULL, NULL);
+      UNLOCK;
       return NULL;
     }
+    SAMPLE(newp, size);
     // if size is 0 then call is equivalent to mm_free(ptr)
     if(size == 0){
-        mm_free(ptr);
+        old = free_block(ptr);
+        EVLOG(EV_REALLOC, NULL, ptr, size);
+        CHECK(old, NULL);
+        UNLOCK;
         return 0;
     }
-    // old data copied
-    copy = *(size_t *)((char *)old - SIZE_T_SIZE);
+    // old data copied: the whole payload of the old block
+    if(GUARDED(old)){
+        copy = guard_size(old);
+    } else{
+        copy = GET_SIZE(HDRP(old)) - DSIZE;
+    }
     if (size < copy){
       copy = size;
     }
-    // Payload of ptr block copied into payload of new block
-    memcpy(newp, old, copy);
+    // Payload of ptr block copied into payload of new block, around the
+    // cache if it is big (see copy.c)
+    PROFILE_START(t_copy);
+    copy_move(newp, old, copy);
+    PROFILE_STOP(t_copy, MM_PHASE_COPY);
     // old block is freed
-    mm_free(old);
+    old = free_block(old);
+    STAT_INC(realloc_moved);
+    EVLOG(EV_REALLOC, newp, ptr, size);
+    CHECK(newp, old);
+    UNLOCK;
     // Pointed to the new block returned
     return newp;
 }
-// Check Method from TA Discussion Session Zachary Leeper
-// global variables
-static freeblock_t *freeHead;
-static header_t *firstHead;
-static int num_freeblocks;
 
-/* Derived from Zachary Leeper's TA Discussion Session
- * mm_check - Scans the heap for inconsistencies, should exit with an assert
- * if an inconsistency is found.
+/*
+ * mm_heap_walk - Calls f on every block between the prologue and the
+ * epilogue, in address order. Allocates nothing, so it is safe to call
+ * at any point between requests. f must not call back into the package.
+ * Returns the nonzero value f stopped the walk with, or 0.
  */
-void mm_check()
-{
-    header_t *h = firstHead;
-    bool prev_alloc = !get_alloc(h);
-    //assert prologue header is correct
-    assert(get_below_header(h) == (header_t *) mem_heap_lo());
-    //block level invariants
-    while(get_size(h > 0)){
-        footer_t *f = get_footer(h);
-        size_t size = get_size(h);
-        //assert header and footer have the same size and allocation
-        assert(get_size_footer(f) == size);
-        //assert header and footer match
-        assert((void *)f - size + sizeof(footer_t) == h);
-        //assert no contiguous free blocks
-        assert(prev_alloc != 0 && get_alloc(h) != 0);
-        //assert size is aligned
-        assert(size % ALIGNMENT == 0);
-        assert((long) get_payload(h) % ALIGNMENT == 0);
-        //assert header/footer inside the heap
-        assert(h > mem_heap_lo() && h < mem_heap_hi());
-        prev_alloc = get_alloc(h);
-        h = get_above_header(h);
-    }
-    //assert epilogue is correct
-    assert((void *) get_above_header(h) == mem_heap_hi() - 7);
-    freeblock_t *fb = freeHead;
-    freeblock_t *prev = freeHead->prev;
-    freeblock_t *next = freeHead->next;
-    int count = 0;
-    //list level invariants
-    while(fb){
-        count++;
-        h = get_freeblock_header(fb);
-        //assert block is actually free
-        assert(!get_alloc(h));
-        if(prev)
-            assert(prev->next == fb);
-        if(next)
-            assert(next->prev == fb);
-        assert(fb > mem_heap_lo() && fb < mem_heap_hi());
-        fb = next;
-    }
-    //check for backwards cycle
-    fb = prev;
-    while(fb){
-        fb = fb->prev;
-    }
-    //assert number of freeblocks in the list = number of free blocks
-    assert(count == num_freeblocks);
+int mm_heap_walk(mm_walk_funct f, void *ctx)
+{
+    char *bp;
+    int ret = 0;
+    LOCK;
+    for(bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+        if((ret = f(bp, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)), ctx)) != 0){
+            break;
+        }
+    }
+    UNLOCK;
+    return ret;
+}
+
+/*
+ * mm_heap_snapshot - Writes the heap's block map to fd in the format of
+ * heapsnap.h, walking it with mm_heap_walk. Needs no memory beyond the
+ * stack, however large the heap. Returns 0, or -1 if a write failed.
+ */
+int mm_heap_snapshot(int fd)
+{
+    snapshot_t snap;
+    heapsnap_hdr_t hdr;
+    snap.fd = fd;
+    snap.len = 0;
+    snap.err = 0;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HEAPSNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = HEAPSNAP_VERSION;
+    LOCK;
+    hdr.heap_bytes = mem_heapsize();
+    hdr.first = HDRP(NEXT_BLKP(heap_listp)) - (char *)mem_heap_lo();
+    UNLOCK;
+    if(write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)){
+        return -1;
+    }
+    mm_heap_walk(snapshot_block, &snap);
+    snapshot_put(&snap, 0);
+    if(snap.len > 0 && write(fd, snap.buf, snap.len * sizeof(uint32_t)) !=
+       snap.len * sizeof(uint32_t)){
+        snap.err = 1;
+    }
+    return snap.err ? -1 : 0;
+}
+
+/*
+ * mm_usable_size - Returns the number of payload bytes in the allocated
+ * block ptr, which may be more than were asked for. The rest of the block
+ * is header and footer.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if(GUARDED(ptr)){
+        return guard_size(ptr);
+    }
+    return GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+/*
+ * mm_stats - Fills in *out with the statistics gathered since mm_init.
+ */
+void mm_stats(struct mm_stats *out)
+{
+    LOCK;
+    *out = stats;
+    out->heap_bytes = mem_heapsize();
+    out->peak_heap_bytes = peak_heap;
+    UNLOCK;
+}
+
+/*
+ * mm_fitstats - Fills in *out with the find_fit search statistics since
+ * mm_init. Returns 0, leaving *out zeroed, unless built with MM_FITSTATS.
+ */
+int mm_fitstats(struct mm_fitstats *out)
+{
+    memset(out, 0, sizeof(struct mm_fitstats));
+#ifdef MM_FITSTATS
+    LOCK;
+    *out = fitstats;
+    UNLOCK;
+    return 1;
+#else
     return 0;
+#endif
 }
 
+/*
+ * mm_profile - Fills in *out with the ticks spent in each phase since
+ * mm_init. Returns 0, leaving *out zeroed, unless built with MM_PROFILE.
+ */
+int mm_profile(struct mm_profile *out)
+{
+    memset(out, 0, sizeof(struct mm_profile));
+#ifdef MM_PROFILE
+    LOCK;
+    *out = profile;
+    UNLOCK;
+    return 1;
+#else
+    return 0;
+#endif
+}
 
+/*
+ * mm_heapprof_start - Starts sampling about one allocation every interval
+ * bytes, dropping any earlier samples. An interval of 0 stops sampling.
+ */
+int mm_heapprof_start(unsigned long interval)
+{
+#ifndef MM_NOHEAPPROF
+    LOCK;
+    heapprof_reset(interval);
+    sample_countdown = heapprof_next();
+    UNLOCK;
+    return 0;
+#else
+    return -1;
+#endif
+}
 
+/*
+ * mm_heapprof_dump - Writes a profile of the sampled live blocks to fd.
+ */
+int mm_heapprof_dump(int fd)
+{
+#ifndef MM_NOHEAPPROF
+    int ret;
+    LOCK;
+    ret = heapprof_write(fd);
+    UNLOCK;
+    return ret;
+#else
+    return -1;
+#endif
+}
 
+/*
+ * mm_heapprof_signal - Writes a profile to path whenever signal sig
+ * arrives. The handler can't take the heap lock, so a profile written
+ * in the middle of a request may be slightly off.
+ */
+int mm_heapprof_signal(int sig, const char *path)
+{
+#ifndef MM_NOHEAPPROF
+    return heapprof_on_signal(sig, path);
+#else
+    return -1;
+#endif
+}
 
+/*
+ * mm_heapprof_live - Returns the live heap bytes estimated from the
+ * samples.
+ */
+double mm_heapprof_live(void)
+{
+#ifndef MM_NOHEAPPROF
+    double bytes;
+    LOCK;
+    bytes = heapprof_live();
+    UNLOCK;
+    return bytes;
+#else
+    return -1;
+#endif
+}
 
+/*
+ * mm_copy_engine - Selects the engine mm_realloc copies payloads with,
+ * and the smallest copy it streams
+ */
+int mm_copy_engine(int engine, size_t threshold)
+{
+    int ret;
+    LOCK;
+    ret = copy_select(engine, threshold);
+    UNLOCK;
+    return ret;
+}
 
+/*
+ * mm_guard_start - Starts placing about one allocation in every rate in
+ * the guarded pool, freeing any blocks already there. A rate of 0 stops
+ * it.
+ */
+int mm_guard_start(unsigned long rate)
+{
+#ifndef MM_NOGUARD
+    int ret;
+    LOCK;
+    ret = guard_reset(rate);
+    guard_countdown = guard_next();
+    UNLOCK;
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_eventlog_dump - Writes the event log to fd as a binary trace
+ */
+int mm_eventlog_dump(int fd)
+{
+#ifdef MM_EVENTLOG
+    int ret;
+    LOCK;
+    ret = evlog_write(fd);
+    UNLOCK;
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_eventlog_signal - Writes the event log to path whenever signal sig
+ * arrives. The handler can't take the heap lock, so it leaves out any
+ * request still in progress.
+ */
+int mm_eventlog_signal(int sig, const char *path)
+{
+#ifdef MM_EVENTLOG
+    return evlog_on_signal(sig, path);
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_eventlog_crash - Writes the event log to path if the process dies
+ * of a fatal signal.
+ */
+int mm_eventlog_crash(const char *path)
+{
+#ifdef MM_EVENTLOG
+    return evlog_on_crash(path);
+#else
+    return -1;
+#endif
+}
+
+#ifndef MM_NOGUARD
+/*
+    Helper: places a block of size bytes in the guarded pool, if there's
+    room, and starts the next countdown
+*/
+static void *guard_block(size_t size)
+{
+    void *bp = guard_alloc(size);
+    guard_countdown = guard_next();
+    if(bp != NULL){
+        STAT_INC(guarded);
+    }
+    return bp;
+}
+#endif
+
+#ifndef MM_NOHEAPPROF
+/*
+    Helper: flags the block bp, just allocated for a request of size
+    bytes, as sampled, records it, and starts the next countdown.
+*/
+static void sample_block(void *bp, size_t size)
+{
+    PUT(HDRP(bp), GET(HDRP(bp)) | SAMPLED);
+    heapprof_record(bp, size);
+    sample_countdown = heapprof_next();
+}
+#endif
+
+/*
+    Helper: mm_heap_walk callback that adds a block's word to the
+    snapshot_t that ctx points to
+*/
+static int snapshot_block(void *bp, size_t size, int alloc, void *ctx)
+{
+    snapshot_put((snapshot_t *)ctx,
+                 (uint32_t)size | (alloc ? HEAPSNAP_ALLOC : 0));
+    return 0;
+}
+
+/*
+    Helper: appends a block word to the snapshot's buffer, first writing the
+    buffer out if it is full
+*/
+static void snapshot_put(snapshot_t *snap, uint32_t word)
+{
+    if(snap->len == SNAP_WORDS){
+        if(write(snap->fd, snap->buf, sizeof(snap->buf)) != sizeof(snap->buf)){
+            snap->err = 1;
+        }
+        snap->len = 0;
+    }
+    snap->buf[snap->len++] = word;
+}
+
+#ifndef MM_NOSTATS
+/*
+    Helper: the mm_stats size class of a request of size bytes
+*/
+static int size_class(size_t size)
+{
+    int c;
+    if(size <= 16){
+        return 0;
+    }
+    c = (int)(8 * sizeof(unsigned long)) - __builtin_clzl(size - 1) - 4;
+    return (c < MM_SIZE_CLASSES) ? c : MM_SIZE_CLASSES - 1;
+}
+#endif
+
+/*
+ * mm_check - Sweeps the whole heap, checking the prologue, every block's
+ * boundary tags, that no two free blocks sit side by side, that the next
+ * fit pointer is at a block, and the epilogue. Returns 0 if the heap is
+ * consistent, or -1 after describing the first problem on stderr.
+ */
+int mm_check(void)
+{
+    int ret;
+    LOCK;
+    ret = check_heap();
+    UNLOCK;
+    return ret;
+}
 
+/*
+ * mm_check_every - Turns on checking as the heap is used: every request
+ * checks the blocks around the ones it changed, and every nth request
+ * also calls mm_check. A failed check aborts, with the problem on stderr.
+ * n = 0 turns checking off.
+ */
+void mm_check_every(int n)
+{
+    LOCK;
+    check_every = n;
+    check_countdown = n;
+    UNLOCK;
+}
 
+/*
+    Helper: the check made by every request while checking is on. The
+    caller holds the heap lock.
+*/
+static int check_request(void *bp, void *other)
+{
+    if(bp != NULL && check_near(bp) < 0){
+        return -1;
+    }
+    if(other != NULL && check_near(other) < 0){
+        return -1;
+    }
+    if(--check_countdown <= 0){
+        check_countdown = check_every;
+        return check_heap();
+    }
+    return 0;
+}
+
+/*
+    Helper: does the work of mm_check. The caller holds the heap lock.
+*/
+static int check_heap(void)
+{
+    char *bp;
+    bool seen_finder = (finder == heap_listp);
+    int prev_alloc = 1;
+#ifndef MM_NOSTATS
+    unsigned long live = 0;
+#endif
+    if(GET(HDRP(heap_listp)) != PACK(DSIZE, 1) ||
+       GET(FTRP(heap_listp)) != PACK(DSIZE, 1)){
+        return check_failed(heap_listp, "bad prologue");
+    }
+    for(bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+        if(check_block(bp) < 0){
+            return -1;
+        }
+        if(!prev_alloc && !GET_ALLOC(HDRP(bp))){
+            return check_failed(bp, "free block not coalesced with the one before");
+        }
+        prev_alloc = GET_ALLOC(HDRP(bp));
+#ifndef MM_NOSTATS
+        if(prev_alloc){
+            live += GET_SIZE(HDRP(bp)) - DSIZE;
+        }
+#endif
+        seen_finder |= (bp == finder);
+    }
+    // bp is the epilogue now; the next fit pointer may rest on it too
+    if(check_block(bp) < 0){
+        return -1;
+    }
+    if(!seen_finder && bp != finder){
+        return check_failed(finder, "next fit pointer not at a block");
+    }
+#ifndef MM_NOSTATS
+    // The allocated blocks should hold just the bytes mm_stats counted
+    if(live != stats.live_bytes){
+        return check_failed(heap_listp, "allocated bytes differ from mm_stats");
+    }
+#endif
+    return 0;
+}
 
+/*
+    Helper: checks block bp and its neighbours on either side, and that
+    none of them is a free block next to another one
+*/
+static int check_near(void *bp)
+{
+    char *prev, *next;
+    if(check_block(bp) < 0){
+        return -1;
+    }
+    prev = PREV_BLKP(bp);
+    next = NEXT_BLKP(bp);
+    if(prev != heap_listp && check_block(prev) < 0){
+        return -1;
+    }
+    if(NEXT_BLKP(prev) != (char *)bp){
+        return check_failed(bp, "previous block's footer doesn't lead here");
+    }
+    if(check_block(next) < 0){
+        return -1;
+    }
+    if(!GET_ALLOC(HDRP(bp)) &&
+       (!GET_ALLOC(HDRP(prev)) || !GET_ALLOC(HDRP(next)))){
+        return check_failed(bp, "free block not coalesced with a neighbour");
+    }
+    return 0;
+}
 
+/*
+    Helper: checks that block bp lies in the heap, is aligned, is at least
+    the minimum size, and that its header and footer agree. The header of
+    a sampled block carries SAMPLED, which its footer doesn't. The 
+    epilogue (size 0) must be the last word of the heap.
+*/
+static int check_block(void *bp)
+{
+    char *lo = mem_heap_lo(), *hi = mem_heap_hi();
+    unsigned int hdr;
+    size_t size;
+    if((char *)bp <= lo || (char *)bp > hi + 1 || (size_t)bp % ALIGNMENT){
+        return check_failed(bp, "block pointer outside the heap or misaligned");
+    }
+    hdr = GET(HDRP(bp));
+    size = GET_SIZE(HDRP(bp));
+    if(size == 0){
+        if(HDRP(bp) != hi - (WSIZE - 1) || !(hdr & 0x1)){
+            return check_failed(bp, "bad epilogue");
+        }
+        return 0;
+    }
+    if(size < 2 * DSIZE || size % ALIGNMENT){
+        return check_failed(bp, "bad block size");
+    }
+    if(FTRP(bp) + WSIZE - 1 > hi){
+        return check_failed(bp, "block runs past the end of the heap");
+    }
+    if((hdr & SAMPLED) && !(hdr & 0x1)){
+        return check_failed(bp, "free block marked sampled");
+    }
+    if((hdr & ~SAMPLED) != GET(FTRP(bp))){
+        return check_failed(bp, "header and footer differ");
+    }
+    return 0;
+}
 
+/*
+    Helper: reports problem with block bp on stderr. Returns -1.
+*/
+static int check_failed(void *bp, const char *problem)
+{
+    fprintf(stderr, "mm_check: %s at block %p (heap offset %ld, "
+            "header 0x%x)\n", problem, bp,
+            (long)((char *)bp - (char *)mem_heap_lo()), GET(HDRP(bp)));
+    return -1;
+}
@@ -4,6 +4,128 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern int mm_is_threadsafe(void);
+
+/* 
+ * Called by mm_heap_walk for each block in address order, with the 
+ * block's payload pointer, total size (including overhead), and whether
+ * it is allocated. Returning nonzero stops the walk.
+ */
+typedef int (*mm_walk_funct)(void *bp, size_t size, int alloc, void *ctx);
+extern int mm_heap_walk(mm_walk_funct f, void *ctx);
+extern size_t mm_usable_size(void *ptr);
+
+/* Write the heap's block map to fd, in the format of heapsnap.h */
+extern int mm_heap_snapshot(int fd);
+
+/* 
+ * Heap consistency checks. mm_check sweeps the whole heap and returns 0
+ * if it is consistent, or -1 after describing the first problem on 
+ * stderr. Once mm_check_every(n) is called, every request checks the 
+ * blocks around the ones it changed and every nth request sweeps the 
+ * whole heap too, aborting on a problem; n = 0 turns this off.
+ */
+extern int mm_check(void);
+extern void mm_check_every(int n);
+
+/* 
+ * Allocator statistics since the last mm_init. Every field is an 
+ * unsigned long; byte counts are in bytes. Requests are sorted into 
+ * size classes by size: class 0 is up to 16 bytes, class i up to 
+ * 16 << i bytes, and the last class holds everything larger.
+ */
+#define MM_SIZE_CLASSES 16
+struct mm_stats {
+    unsigned long mallocs;          /* mm_malloc calls */
+    unsigned long frees;            /* mm_free calls */
+    unsigned long reallocs;         /* mm_realloc calls... */
+    unsigned long realloc_moved;    /* ... that moved the block */
+    unsigned long fit_hits;         /* blocks placed in a free block */
+    unsigned long fit_misses;       /* blocks placed after extend_heap */
+    unsigned long guarded;          /* blocks placed in the guarded pool */
+    unsigned long extend_heaps;     /* extend_heap calls */
+    unsigned long coalesces[4];     /* coalesce calls by case (see mm.c) */
+    unsigned long heap_bytes;       /* current heap size */
+    unsigned long peak_heap_bytes;  /* largest heap size */
+    unsigned long live_bytes;       /* bytes in allocated blocks */
+    unsigned long class_mallocs[MM_SIZE_CLASSES]; /* mallocs by class */
+};
+extern void mm_stats(struct mm_stats *out);
+
+/* 
+ * find_fit search statistics since the last mm_init, kept only if mm.c
+ * is built with -DMM_FITSTATS. probe_hist[0] counts searches that probed
+ * no block, and probe_hist[i] those that probed 2^(i-1) to 2^i - 1 
+ * blocks; the last bucket holds everything longer.
+ */
+#define MM_FIT_BUCKETS 12
+struct mm_fitstats {
+    unsigned long searches;   /* find_fit calls */
+    unsigned long probes;     /* blocks visited over all searches */
+    unsigned long max_probes; /* most blocks visited by one search */
+    unsigned long wraps;      /* searches that went on into the 2nd loop */
+    unsigned long failures;   /* searches that found nothing (extend_heap) */
+    unsigned long probe_hist[MM_FIT_BUCKETS]; /* searches by length */
+};
+extern int mm_fitstats(struct mm_fitstats *out);
+
+/* 
+ * Tick counts by phase of the allocator's work since the last mm_init,
+ * kept only if mm.c is built with -DMM_PROFILE. The phases don't 
+ * overlap: extend_heap time excludes the coalesce it ends with.
+ */
+enum {
+    MM_PHASE_ADJUST,    /* rounding the request up to a block size */
+    MM_PHASE_FIT,       /* find_fit */
+    MM_PHASE_PLACE,     /* place, including splitting */
+    MM_PHASE_COALESCE,  /* coalesce */
+    MM_PHASE_EXTEND,    /* extend_heap and mem_sbrk */
+    MM_PHASE_COPY,      /* copying the payload in mm_realloc */
+    MM_PHASES
+};
+struct mm_profile {
+    unsigned long long ticks[MM_PHASES]; /* read_ticks() ticks per phase */
+    unsigned long calls[MM_PHASES];      /* times each phase was timed */
+};
+extern int mm_profile(struct mm_profile *out);
+
+/* 
+ * Sampling heap profiler. Once started, about one allocation is sampled
+ * every interval bytes and its call stack kept until it is freed. 
+ * Returns -1 from each call if mm.c was built with -DMM_NOHEAPPROF.
+ */
+extern int mm_heapprof_start(unsigned long interval); /* 0 stops it */
+extern int mm_heapprof_dump(int fd);        /* write a profile to fd */
+extern int mm_heapprof_signal(int sig, const char *path); /* ...on sig */
+extern double mm_heapprof_live(void);       /* estimated live bytes */
+
+/* 
+ * The engine mm_realloc copies payloads with: one of the COPY_xxx of
+ * copy.h, or COPY_AUTO for the best the CPU supports (the default), and
+ * the smallest copy it streams past the cache (0 for the default, which
+ * is 3/4 of the last level cache). Returns the engine, or -1 if the CPU
+ * doesn't support it.
+ */
+extern int mm_copy_engine(int engine, size_t threshold);
+
+/* 
+ * Guarded sampling. Once started, about one allocation in every rate (of
+ * up to a page) is placed at the end of a page of its own, between 
+ * inaccessible guard pages, and the page is made inaccessible when the
+ * block is freed. An overflow or a use after free of the block then 
+ * faults at once and is reported on stderr. 0 stops it. Returns -1 if
+ * mm.c was built with -DMM_NOGUARD or the pool can't be mapped.
+ */
+extern int mm_guard_start(unsigned long rate);
+
+/* 
+ * Event log of the last requests each thread made, kept only if mm.c is
+ * built with -DMM_EVENTLOG. It is written out as a binary trace (see 
+ * evlog.h) that mdriver -f replays. Each call returns -1 without it.
+ */
+extern int mm_eventlog_dump(int fd);        /* write the log to fd */
+extern int mm_eventlog_signal(int sig, const char *path); /* ...on sig */
+extern int mm_eventlog_crash(const char *path); /* ...on a crash */
 
 
 /* 
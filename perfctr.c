@@ -0,0 +1,161 @@
+/*
+ * perfctr.c - Count hardware events (instructions, cycles, cache and 
+ *     TLB misses, ...) with the Linux perf_event_open interface. 
+ *
+ * Each event is opened as its own counter, so an event that this CPU 
+ * or kernel doesn't support, or that we aren't permitted to count 
+ * (see /proc/sys/kernel/perf_event_paranoid), simply reads as -1 
+ * while the others keep working; with -v, the reason each one couldn't
+ * be opened is printed. On other systems nothing is counted.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+extern int verbose; /* -v option in mdriver.c */
+
+static char *names[NUM_PERFCTRS] = {
+    "instr", "cycles", "L1D-miss", "LLC-miss", "br-miss", "dTLB-miss"
+};
+
+static int fds[NUM_PERFCTRS] = {-1, -1, -1, -1, -1, -1};
+static pid_t owner = 0;  /* process that opened the counters */
+
+#ifdef __linux__
+/* 
+ * cache_config - Encode a perf hardware cache event 
+ */
+static unsigned long long cache_config(int cache, int op, int result)
+{
+    return cache | (op << 8) | (result << 16);
+}
+
+/* 
+ * open_counter - Open a disabled counter on this process for the event
+ *     of counter i, and print why it failed if it did (with -v)
+ */
+static void open_counter(int i, int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;  /* allowed at the default paranoia level */
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fds[i] < 0 && verbose)
+	printf("Can't count %s: %s%s\n", names[i], strerror(errno),
+	       (errno == EACCES || errno == EPERM) ? 
+	       " (check perf_event_paranoid)" : "");
+}
+#endif
+
+/*
+ * perfctr_init - Open the counters for the calling process. Counters are
+ *     per process, so a forked worker reopens its own on first use.
+ *     Returns the number of counters available.
+ */
+int perfctr_init(void)
+{
+    int i, n = 0;
+
+    if (owner == getpid()) {
+	for (i = 0; i < NUM_PERFCTRS; i++)
+	    n += (fds[i] >= 0);
+	return n;
+    }
+    for (i = 0; i < NUM_PERFCTRS; i++) {
+	if (fds[i] >= 0)
+	    close(fds[i]);
+	fds[i] = -1;
+    }
+    owner = getpid();
+
+#ifdef __linux__
+    open_counter(PERFCTR_INSTRUCTIONS, 
+		 PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    open_counter(PERFCTR_CYCLES, 
+		 PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    open_counter(PERFCTR_L1D_MISSES, PERF_TYPE_HW_CACHE, 
+		 cache_config(PERF_COUNT_HW_CACHE_L1D, 
+			      PERF_COUNT_HW_CACHE_OP_READ,
+			      PERF_COUNT_HW_CACHE_RESULT_MISS));
+    open_counter(PERFCTR_LLC_MISSES, 
+		 PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    open_counter(PERFCTR_BRANCH_MISSES, 
+		 PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    open_counter(PERFCTR_DTLB_MISSES, PERF_TYPE_HW_CACHE, 
+		 cache_config(PERF_COUNT_HW_CACHE_DTLB, 
+			      PERF_COUNT_HW_CACHE_OP_READ,
+			      PERF_COUNT_HW_CACHE_RESULT_MISS));
+#endif
+
+    for (i = 0; i < NUM_PERFCTRS; i++)
+	n += (fds[i] >= 0);
+    if (n == 0 && verbose)
+	printf("Hardware performance counters are not available.\n");
+    return n;
+}
+
+/*
+ * perfctr_start - Reset and start every available counter
+ */
+void perfctr_start(void)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < NUM_PERFCTRS; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+#endif
+}
+
+/*
+ * perfctr_stop - Stop the counters and store their counts in counts[]. 
+ *     If the kernel had to multiplex the counters, each count is scaled
+ *     up by the fraction of the time it was actually running.
+ */
+void perfctr_stop(double counts[NUM_PERFCTRS])
+{
+    int i;
+
+    for (i = 0; i < NUM_PERFCTRS; i++)
+	counts[i] = -1;
+#ifdef __linux__
+    for (i = 0; i < NUM_PERFCTRS; i++) {
+	unsigned long long val[3]; /* value, time enabled, time running */
+
+	if (fds[i] < 0)
+	    continue;
+	ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fds[i], val, sizeof(val)) != sizeof(val) || val[2] == 0)
+	    continue;
+	counts[i] = (double)val[0] * ((double)val[1] / (double)val[2]);
+    }
+#endif
+}
+
+/*
+ * perfctr_name - Return the short column name of counter i
+ */
+char *perfctr_name(int i)
+{
+    return names[i];
+}
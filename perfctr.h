@@ -0,0 +1,25 @@
+/*
+ * perfctr.h - prototypes for the hardware performance counter routines 
+ *     in perfctr.c
+ */
+
+/* The events that perfctr.c tries to count */
+#define PERFCTR_INSTRUCTIONS  0
+#define PERFCTR_CYCLES        1
+#define PERFCTR_L1D_MISSES    2
+#define PERFCTR_LLC_MISSES    3
+#define PERFCTR_BRANCH_MISSES 4
+#define PERFCTR_DTLB_MISSES   5
+#define NUM_PERFCTRS          6
+
+/* Open the counters for this process. Returns the number available. */
+int perfctr_init(void);
+
+/* Reset and start every available counter */
+void perfctr_start(void);
+
+/* Stop the counters and store their counts, or -1 if unavailable */
+void perfctr_stop(double counts[NUM_PERFCTRS]);
+
+/* Short column name of counter i */
+char *perfctr_name(int i);
@@ -0,0 +1,188 @@
+/*
+ * sysenv.c - Routines that steady the machine for benchmarking (CPU
+ *     pinning, scheduling priority, memory locking) and record the 
+ *     conditions a run happened under, so that results taken on the 
+ *     same host on different days can be compared with confidence.
+ */
+#define _GNU_SOURCE         /* for sched_setaffinity and the CPU_xxx macros */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include "sysenv.h"
+
+/* Scheduling class we ended up in, for sysenv_describe */
+static char *sched_class = "normal";
+static int locked = 0;
+
+/*
+ * read_line - Read the first line of a (sysfs) file into buf, without
+ *     the newline. Returns 0 if the file couldn't be read.
+ */
+static int read_line(char *path, char *buf, int len)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    if (fgets(buf, len, fp) == NULL) {
+	fclose(fp);
+	return 0;
+    }
+    fclose(fp);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 1;
+}
+
+/*
+ * sysenv_pin - Pin the calling process (and any children it forks 
+ *     later) to the given CPU
+ */
+int sysenv_pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+	return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+/*
+ * sysenv_raise_priority - Move to the SCHED_FIFO real-time class if 
+ *     we may, otherwise to the highest nice level we may. A mid-range
+ *     real-time priority keeps us ahead of ordinary processes while 
+ *     leaving the kernel's own real-time threads alone.
+ */
+int sysenv_raise_priority(void)
+{
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + 
+			    sched_get_priority_max(SCHED_FIFO)) / 2;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+	sched_class = "fifo";
+	return 0;
+    }
+    if (setpriority(PRIO_PROCESS, 0, -20) == 0) {
+	sched_class = "nice";
+	return 0;
+    }
+    return -1;
+}
+
+/*
+ * sysenv_lock_memory - Lock all current and future pages into RAM so
+ *     that page faults and swapping don't show up in the timings
+ */
+int sysenv_lock_memory(void)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+	return -1;
+    locked = 1;
+    return 0;
+}
+
+/*
+ * sysenv_describe - Record the host, CPU model, the CPU we run on and
+ *     its frequency governor and clock rate, and the isolation settings
+ */
+void sysenv_describe(sysenv_t *env)
+{
+    FILE *fp;
+    char line[256], path[128], *p;
+    struct utsname uts;
+    cpu_set_t set;
+    int cpu;
+
+    memset(env, 0, sizeof(sysenv_t));
+    strcpy(env->cpu_model, "unknown");
+    strcpy(env->governor, "unknown");
+    if (uname(&uts) == 0) {
+	snprintf(env->host, sizeof(env->host), "%.63s", uts.nodename);
+	snprintf(env->kernel, sizeof(env->kernel), "%.63s", uts.release);
+    }
+
+    /* Which CPU are we on? Only meaningful if we're pinned to one. */
+    env->cpu = -1;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0 && 
+	CPU_COUNT(&set) == 1) {
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	    if (CPU_ISSET(cpu, &set))
+		env->cpu = cpu;
+    }
+    cpu = (env->cpu >= 0) ? env->cpu : sched_getcpu();
+    if (cpu < 0)
+	cpu = 0;
+
+    /* The CPU model and, failing cpufreq, its nominal clock rate */
+    if ((fp = fopen("/proc/cpuinfo", "r")) != NULL) {
+	while (fgets(line, sizeof(line), fp) != NULL) {
+	    if ((p = strchr(line, ':')) == NULL)
+		continue;
+	    p += 1 + strspn(p + 1, " \t");
+	    p[strcspn(p, "\n")] = '\0';
+	    if (strncmp(line, "model name", 10) == 0 && 
+		strcmp(env->cpu_model, "unknown") == 0)
+		snprintf(env->cpu_model, sizeof(env->cpu_model), "%s", p);
+	    else if (strncmp(line, "cpu MHz", 7) == 0 && env->cur_mhz == 0)
+		env->cur_mhz = atof(p);
+	}
+	fclose(fp);
+    }
+
+    /* The frequency governor and clock rates of our CPU */
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",
+	    cpu);
+    read_line(path, env->governor, sizeof(env->governor));
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", 
+	    cpu);
+    if (read_line(path, line, sizeof(line)))
+	env->cur_mhz = atof(line) / 1e3;  /* kHz */
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", 
+	    cpu);
+    if (read_line(path, line, sizeof(line)))
+	env->max_mhz = atof(line) / 1e3;
+
+    snprintf(env->sched, sizeof(env->sched), "%s", sched_class);
+    env->locked = locked;
+}
+
+/*
+ * sysenv_llc_size - Return the size in bytes of the last level cache,
+ *     L3 or else L2, or 8 MB if the system won't say
+ */
+long sysenv_llc_size(void)
+{
+    long bytes = -1;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if ((bytes = sysconf(_SC_LEVEL3_CACHE_SIZE)) <= 0)
+	bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return bytes > 0 ? bytes : 1L << 23;
+}
+
+/*
+ * sysenv_print - Print *env in a line or two
+ */
+void sysenv_print(sysenv_t *env)
+{
+    printf("Host %s, kernel %s, %s\n", env->host, env->kernel, 
+	   env->cpu_model);
+    if (env->cpu >= 0)
+	printf("Pinned to CPU %d", env->cpu);
+    else
+	printf("Not pinned");
+    printf(", governor %s, %.0f MHz", env->governor, env->cur_mhz);
+    if (env->max_mhz > 0)
+	printf(" (max %.0f MHz)", env->max_mhz);
+    printf(", %s scheduling, memory %slocked\n", env->sched, 
+	   env->locked ? "" : "not ");
+}
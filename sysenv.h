@@ -0,0 +1,34 @@
+/*
+ * sysenv.h - prototypes for the benchmark environment routines in sysenv.c
+ */
+
+/* Describes the machine and the conditions a benchmark ran under */
+typedef struct {
+    char host[64];         /* host name */
+    char kernel[64];       /* kernel release */
+    char cpu_model[128];   /* CPU model name */
+    int cpu;               /* CPU the benchmark is pinned to, or -1 */
+    char governor[32];     /* cpufreq governor of that CPU */
+    double cur_mhz;        /* its current frequency, or 0 if unknown */
+    double max_mhz;        /* its maximum frequency, or 0 if unknown */
+    char sched[16];        /* scheduling class: "normal", "nice" or "fifo" */
+    int locked;            /* is all memory locked (mlockall)? */
+} sysenv_t;
+
+/* Pin the calling process to the given CPU. Returns 0 if OK, -1 if not. */
+int sysenv_pin(int cpu);
+
+/* Raise the scheduling priority as far as permitted. Returns 0 if raised. */
+int sysenv_raise_priority(void);
+
+/* Lock current and future memory into RAM. Returns 0 if OK, -1 if not. */
+int sysenv_lock_memory(void);
+
+/* Record the machine and the current conditions in *env */
+void sysenv_describe(sysenv_t *env);
+
+/* Print *env in a line or two */
+void sysenv_print(sysenv_t *env);
+
+/* Size of the last level cache in bytes (8 MB if the system won't say) */
+long sysenv_llc_size(void);
@@ -0,0 +1,712 @@
+/*
+ * gen_trace.c - Generates synthetic traces of malloc, realloc and free
+ *     requests from a model of a program's allocations: how big its
+ *     blocks are, how long they live, which of them grow by realloc, and
+ *     how all of that changes from one phase of the program to the next.
+ *     Traces are written in the .rep format (see README) or as binary
+ *     traces in the format of ../evlog.h, which mdriver -f reads too.
+ *
+ *     Time is counted in allocations. Each new block draws a size and a
+ *     lifetime, and its free (and any reallocs) are queued until they are
+ *     due; between two allocations the requests that have come due are
+ *     written out. Requests due within WHEEL allocations wait in a timing
+ *     wheel, a bucket per allocation, and later ones in a heap until they
+ *     come that close, so most requests cost O(1) and traces of hundreds
+ *     of millions of requests take seconds.
+ *
+ *     usage: gen_trace [options] <outfile>  (see usage() or -h)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <getopt.h>
+#include "../evlog.h"
+
+#define MAX_PHASES  64       /* most phases in a trace */
+#define MAX_SIZE    INT_MAX  /* largest block mdriver can replay */
+#define OUTBUF      (1 << 20)/* bytes buffered between fwrite()s */
+#define HDRWIDTH    20       /* width of a .rep header line, for rewriting */
+#define WHEEL       (1 << 16)/* buckets in the timing wheel */
+#define MAX_ZIPF    (8 << 24)/* largest Zipf size (a table of 16M sizes) */
+
+/* Requests, in the order of their .rep tags "afr" */
+enum { ALLOC_OP, FREE_OP, REALLOC_OP };
+
+/* Kinds of distribution */
+enum { DIST_UNIFORM, DIST_LOGNORMAL, DIST_EXP, DIST_TABLE };
+
+/*
+ * A distribution of sizes or lifetimes. Table distributions (Zipf and
+ * histograms) draw entry i with probability cdf[i] - cdf[i-1], then a
+ * value uniformly from lo[i] to hi[i].
+ */
+typedef struct {
+    int kind;                /* DIST_xxx */
+    double a, b;             /* min and max, or median and sigma, or mean */
+    int entries;             /* table entries */
+    double *cdf;             /* cumulative probability of each entry */
+    uint64_t *lo, *hi;       /* range of values of each entry */
+} dist_t;
+
+/* One phase of the program */
+typedef struct {
+    uint64_t ops;            /* requests in the phase */
+    dist_t size;             /* block sizes, in bytes */
+    dist_t life;             /* block lifetimes, in allocations */
+    double chain_prob;       /* chance that a block grows by realloc... */
+    double chain_growth;     /* ... by this factor each time... */
+    int chain_steps;         /* ... this many times over its lifetime */
+    int free_all;            /* free every live block when it ends */
+} phase_t;
+
+/* 
+ * A pending free (size 0) or realloc. The requests on one block fall due
+ * at different times, so requests due at the same time may go in any
+ * order.
+ */
+typedef struct {
+    uint64_t due;            /* allocation count when it is due */
+    uint32_t id;             /* the block */
+    uint32_t size;           /* new size, or 0 to free it */
+    uint32_t prev;           /* size before the request */
+} event_t;
+
+/* A request in the timing wheel; its bucket says when it is due */
+typedef struct {
+    uint32_t id, size, prev; /* as in event_t */
+    uint32_t next;           /* next in the bucket, or 0 (nodes count from 1) */
+} node_t;
+
+/* The trace being written */
+typedef struct {
+    FILE *fp;
+    int binary;              /* evlog.h format rather than .rep */
+    char *buf;               /* OUTBUF bytes not yet written */
+    size_t len;
+    uint64_t num_ops;        /* requests written */
+    uint64_t num_ids;        /* blocks allocated */
+    uint64_t live_bytes;     /* bytes requested by live blocks */
+    uint64_t peak_bytes;     /* most live_bytes */
+} out_t;
+
+static uint64_t now;         /* allocations so far */
+static uint32_t wheel[WHEEL];/* requests due at now + i in wheel[(now+i) % WHEEL] */
+static node_t *nodes;        /* the wheel's requests; nodes[0] is unused */
+static uint32_t num_nodes, max_nodes, free_nodes; /* ... free ones listed */
+static uint64_t in_wheel;    /* requests in the wheel */
+static event_t *events;      /* heap of requests due later */
+static uint64_t num_events, max_events;
+static uint64_t rng;         /* xorshift64* state */
+
+static void parse_dist(char *spec, dist_t *d, int sizes);
+static void read_histogram(char *path, dist_t *d);
+static void make_zipf(dist_t *d, uint64_t max, double s);
+static uint64_t draw(dist_t *d);
+static double uniform(void);
+static double normal(void);
+static void run_phase(phase_t *ph, out_t *out);
+static void drain(out_t *out);
+static void queue(uint64_t due, uint32_t id, uint32_t size, uint32_t prev);
+static int take_due(event_t *ev);
+static void push_event(event_t *ev);
+static void pop_event(event_t *ev);
+static void emit(out_t *out, int op, uint32_t id, uint32_t size, 
+		 uint32_t prev);
+static void put_num(out_t *out, uint64_t val);
+static void flush_out(out_t *out);
+static void write_header(out_t *out);
+static void usage(void);
+static void app_error(char *msg);
+
+static char msg[1024];
+
+int main(int argc, char **argv)
+{
+    int c, i, num_phases = 0;
+    uint64_t seed = 1, ops = 100000;
+    phase_t next, phases[MAX_PHASES];
+    out_t out;
+
+    /* The default phase: sizes and lifetimes like gen_random.pl's */
+    memset(&next, 0, sizeof(next));
+    parse_dist("uniform:1:32768", &next.size, 1);
+    parse_dist("exp:1000", &next.life, 0);
+    memset(&out, 0, sizeof(out));
+
+    while ((c = getopt(argc, argv, "n:s:z:l:r:p:Fbh")) != EOF) {
+	switch (c) {
+	case 'n': /* Requests in the trace, if there are no phases */
+	    ops = strtoull(optarg, NULL, 0);
+	    break;
+	case 's': /* Seed for the random number generator */
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'z': /* Size distribution */
+	    parse_dist(optarg, &next.size, 1);
+	    break;
+	case 'l': /* Lifetime distribution */
+	    parse_dist(optarg, &next.life, 0);
+	    break;
+	case 'r': /* Realloc growth chains */
+	    if (sscanf(optarg, "%lf:%lf:%d", &next.chain_prob,
+		       &next.chain_growth, &next.chain_steps) != 3 ||
+		next.chain_prob < 0 || next.chain_prob > 1 ||
+		next.chain_growth <= 0 || next.chain_steps < 0) {
+		sprintf(msg, "Bad realloc chains \"%s\"", optarg);
+		app_error(msg);
+	    }
+	    break;
+	case 'F': /* Free every live block at the end of the phase */
+	    next.free_all = 1;
+	    break;
+	case 'p': /* End a phase; later options apply to the next one */
+	    if (num_phases == MAX_PHASES)
+		app_error("Too many phases");
+	    next.ops = strtoull(optarg, NULL, 0);
+	    phases[num_phases++] = next;
+	    next.free_all = 0;
+	    break;
+	case 'b': /* Write a binary trace */
+	    out.binary = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	usage();
+	exit(1);
+    }
+    if (num_phases == 0) {
+	next.ops = ops;
+	phases[num_phases++] = next;
+    }
+
+    /* Seed xorshift64* with splitmix64, so that any seed will do */
+    rng = seed + 0x9e3779b97f4a7c15ULL;
+    rng = (rng ^ (rng >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    rng = (rng ^ (rng >> 27)) * 0x94d049bb133111ebULL;
+    rng ^= rng >> 31;
+    if (rng == 0)
+	rng = 1;
+
+    if ((out.fp = fopen(argv[optind], "w")) == NULL) {
+	sprintf(msg, "Could not open %s", argv[optind]);
+	app_error(msg);
+    }
+    if ((out.buf = malloc(OUTBUF)) == NULL)
+	app_error("malloc failed in main");
+    write_header(&out);
+    for (i = 0; i < num_phases; i++)
+	run_phase(&phases[i], &out);
+    drain(&out);
+    flush_out(&out);
+    if (fseek(out.fp, 0, SEEK_SET) < 0)
+	app_error("Can't rewrite the header (is the output a file?)");
+    write_header(&out);
+    if (fclose(out.fp) != 0) {
+	sprintf(msg, "Could not write %s", argv[optind]);
+	app_error(msg);
+    }
+    fprintf(stderr, "%s: %lu requests, %lu blocks, peak %lu bytes\n",
+	    argv[optind], (unsigned long)out.num_ops,
+	    (unsigned long)out.num_ids, (unsigned long)out.peak_bytes);
+    return 0;
+}
+
+/*
+ * parse_dist - Parse a distribution spec into *d. Sizes may also be
+ *     Zipf or histogram distributions (sizes is set).
+ */
+static void parse_dist(char *spec, dist_t *d, int sizes)
+{
+    char path[256];
+    unsigned long max;
+    double a = 0, b = 0;
+
+    memset(d, 0, sizeof(*d));
+    if (sscanf(spec, "uniform:%lf:%lf", &a, &b) == 2 && a >= 0 && b >= a) {
+	d->kind = DIST_UNIFORM;
+    }
+    else if (sscanf(spec, "lognormal:%lf:%lf", &a, &b) == 2 && a > 0 &&
+	     b >= 0) {
+	d->kind = DIST_LOGNORMAL;
+	a = log(a);
+    }
+    else if (!sizes && sscanf(spec, "exp:%lf", &a) == 1 && a > 0) {
+	d->kind = DIST_EXP;
+    }
+    else if (sizes && sscanf(spec, "zipf:%lu:%lf", &max, &b) == 2 &&
+	     max >= 8 && max <= MAX_ZIPF && b > 0) {
+	make_zipf(d, max, b);
+    }
+    else if (sizes && sscanf(spec, "hist:%255s", path) == 1) {
+	read_histogram(path, d);
+    }
+    else {
+	sprintf(msg, "Bad %s distribution \"%s\"", sizes ? "size" : "lifetime",
+		spec);
+	app_error(msg);
+    }
+    d->a = a;
+    d->b = b;
+}
+
+/*
+ * read_histogram - Read a size histogram: lines of "<size> <weight>" or
+ *     "<lo>-<hi> <weight>", with # starting a comment
+ */
+static void read_histogram(char *path, dist_t *d)
+{
+    FILE *fp;
+    char line[256];
+    unsigned long lo, hi;
+    double weight, total = 0;
+    int i, n = 0, max = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s", path);
+	app_error(msg);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	line[strcspn(line, "#\n")] = '\0';
+	if (sscanf(line, "%lu-%lu %lf", &lo, &hi, &weight) != 3) {
+	    if (sscanf(line, "%lu %lf", &lo, &weight) != 2)
+		continue;
+	    hi = lo;
+	}
+	if (hi < lo || hi > MAX_SIZE || weight < 0) {
+	    sprintf(msg, "Bad histogram line \"%s\" in %s", line, path);
+	    app_error(msg);
+	}
+	if (n == max) {
+	    max = max ? 2 * max : 64;
+	    if ((d->cdf = realloc(d->cdf, max * sizeof(double))) == NULL ||
+		(d->lo = realloc(d->lo, max * sizeof(uint64_t))) == NULL ||
+		(d->hi = realloc(d->hi, max * sizeof(uint64_t))) == NULL)
+		app_error("realloc failed in read_histogram");
+	}
+	d->lo[n] = lo;
+	d->hi[n] = hi;
+	d->cdf[n++] = total += weight;
+    }
+    fclose(fp);
+    if (total <= 0) {
+	sprintf(msg, "%s has no weight in it", path);
+	app_error(msg);
+    }
+    for (i = 0; i < n; i++)
+	d->cdf[i] /= total;
+    d->kind = DIST_TABLE;
+    d->entries = n;
+}
+
+/*
+ * make_zipf - Zipf sizes: 8k bytes, for k up to max/8, with probability
+ *     proportional to 1/k^s
+ */
+static void make_zipf(dist_t *d, uint64_t max, double s)
+{
+    int k, n = max / 8;
+    double total = 0;
+
+    if ((d->cdf = malloc(n * sizeof(double))) == NULL ||
+	(d->lo = malloc(n * sizeof(uint64_t))) == NULL)
+	app_error("malloc failed in make_zipf");
+    for (k = 0; k < n; k++) {
+	d->lo[k] = 8 * (uint64_t)(k + 1);
+	d->cdf[k] = total += pow(k + 1, -s);
+    }
+    for (k = 0; k < n; k++)
+	d->cdf[k] /= total;
+    d->hi = d->lo;
+    d->kind = DIST_TABLE;
+    d->entries = n;
+}
+
+/*
+ * draw - Draw a value from *d, at least 1
+ */
+static uint64_t draw(dist_t *d)
+{
+    double x = 1, u;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case DIST_UNIFORM:
+	x = d->a + (uint64_t)(uniform() * (d->b - d->a + 1));
+	break;
+    case DIST_LOGNORMAL:
+	x = exp(d->a + d->b * normal());
+	break;
+    case DIST_EXP:
+	x = 1 + (uint64_t)(-d->a * log(1 - uniform()));
+	break;
+    case DIST_TABLE:
+	/* The first entry whose cdf is above u */
+	u = uniform();
+	for (lo = 0, hi = d->entries - 1; lo < hi; ) {
+	    mid = (lo + hi) / 2;
+	    if (d->cdf[mid] <= u)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	x = d->lo[lo] + (uint64_t)(uniform() * (d->hi[lo] - d->lo[lo] + 1));
+	break;
+    }
+    if (x < 1)
+	return 1;
+    if (x > MAX_SIZE)
+	return MAX_SIZE;
+    return (uint64_t)x;
+}
+
+/*
+ * uniform - A uniform random number in [0, 1), from xorshift64*
+ */
+static double uniform(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * normal - A standard normal random number. Box-Muller makes them in
+ *     pairs; the second is kept for the next call.
+ */
+static double normal(void)
+{
+    static double spare;
+    static int have_spare = 0;
+    double r, t;
+
+    if (have_spare) {
+	have_spare = 0;
+	return spare;
+    }
+    r = sqrt(-2 * log(1 - uniform()));
+    t = 2 * M_PI * uniform();
+    spare = r * sin(t);
+    have_spare = 1;
+    return r * cos(t);
+}
+
+/*
+ * run_phase - Write the requests of one phase
+ */
+static void run_phase(phase_t *ph, out_t *out)
+{
+    uint64_t end = out->num_ops + ph->ops, life;
+    uint32_t id, size, prev;
+    double grown;
+    event_t ev;
+    int j;
+
+    while (out->num_ops < end) {
+	/* Requests that have come due go first */
+	if (take_due(&ev)) {
+	    emit(out, ev.size ? REALLOC_OP : FREE_OP, ev.id, ev.size, ev.prev);
+	    continue;
+	}
+
+	/* Then a new block, with its reallocs and free queued */
+	if (out->num_ids >= UINT32_MAX)
+	    app_error("Too many blocks");
+	id = out->num_ids;
+	size = draw(&ph->size);
+	life = draw(&ph->life);
+	emit(out, ALLOC_OP, id, size, 0);
+	if (ph->chain_steps > 0 && uniform() < ph->chain_prob) {
+	    /* Spread the reallocs over a life of at least one per step */
+	    if (life <= ph->chain_steps)
+		life = ph->chain_steps + 1;
+	    for (j = 1; j <= ph->chain_steps; j++) {
+		prev = size;
+		grown = ceil(size * ph->chain_growth);
+		size = grown > MAX_SIZE ? MAX_SIZE : grown;
+		queue(now + j + (life - ph->chain_steps - 1) * j / 
+		      (ph->chain_steps + 1), id, size, prev);
+	    }
+	}
+	queue(now + life, id, 0, size);
+	now++;
+    }
+    if (ph->free_all)
+	drain(out);
+}
+
+/*
+ * drain - Write every pending request, which frees every live block.
+ *     Time runs on as if there were no allocations.
+ */
+static void drain(out_t *out)
+{
+    event_t ev;
+
+    while (in_wheel + num_events > 0) {
+	if (in_wheel == 0 && events[0].due > now)
+	    now = events[0].due;
+	while (take_due(&ev))
+	    emit(out, ev.size ? REALLOC_OP : FREE_OP, ev.id, ev.size, ev.prev);
+	now++;
+    }
+}
+
+/*
+ * queue - Queue a request on block id, due when due allocations have
+ *     been made (after now)
+ */
+static void queue(uint64_t due, uint32_t id, uint32_t size, uint32_t prev)
+{
+    event_t ev;
+    uint32_t n;
+
+    if (due - now >= WHEEL) {
+	ev.due = due;
+	ev.id = id;
+	ev.size = size;
+	ev.prev = prev;
+	push_event(&ev);
+	return;
+    }
+    if (free_nodes != 0) {
+	n = free_nodes;
+	free_nodes = nodes[n].next;
+    }
+    else {
+	if (num_nodes + 1 >= max_nodes) {
+	    max_nodes = max_nodes ? 2 * max_nodes : 4096;
+	    if ((nodes = realloc(nodes, max_nodes * sizeof(node_t))) == NULL)
+		app_error("realloc failed in queue");
+	}
+	n = ++num_nodes;
+    }
+    nodes[n].id = id;
+    nodes[n].size = size;
+    nodes[n].prev = prev;
+    nodes[n].next = wheel[due % WHEEL];
+    wheel[due % WHEEL] = n;
+    in_wheel++;
+}
+
+/*
+ * take_due - Take a request due now off the queue into *ev. Returns 0 if
+ *     there is none.
+ */
+static int take_due(event_t *ev)
+{
+    event_t far;
+    uint32_t n;
+
+    /* Requests in the heap move to the wheel as they come near */
+    while (num_events > 0 && events[0].due - now < WHEEL) {
+	pop_event(&far);
+	queue(far.due, far.id, far.size, far.prev);
+    }
+    if ((n = wheel[now % WHEEL]) == 0)
+	return 0;
+    ev->due = now;
+    ev->id = nodes[n].id;
+    ev->size = nodes[n].size;
+    ev->prev = nodes[n].prev;
+    wheel[now % WHEEL] = nodes[n].next;
+    nodes[n].next = free_nodes;
+    free_nodes = n;
+    in_wheel--;
+    return 1;
+}
+
+/*
+ * push_event - Put a request in the heap
+ */
+static void push_event(event_t *ev)
+{
+    uint64_t i, parent;
+
+    if (num_events == max_events) {
+	max_events = max_events ? 2 * max_events : 4096;
+	if ((events = realloc(events, max_events * sizeof(event_t))) == NULL)
+	    app_error("realloc failed in push_event");
+    }
+    for (i = num_events++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (events[parent].due <= ev->due)
+	    break;
+	events[i] = events[parent];
+    }
+    events[i] = *ev;
+}
+
+/*
+ * pop_event - Take a request due first off the heap. Moves the hole at
+ *     the root down to a leaf, then the last request up into it, which
+ *     takes about half the comparisons of sifting the last one down.
+ */
+static void pop_event(event_t *ev)
+{
+    uint64_t i, child, parent;
+    event_t last = events[--num_events];
+
+    *ev = events[0];
+    for (i = 0; (child = 2 * i + 1) < num_events; i = child) {
+	if (child + 1 < num_events && events[child + 1].due < 
+	    events[child].due)
+	    child++;
+	events[i] = events[child];
+    }
+    for (; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (events[parent].due <= last.due)
+	    break;
+	events[i] = events[parent];
+    }
+    events[i] = last;
+}
+
+/*
+ * emit - Write one request, which changes block id from prev bytes to
+ *     size, and keep count of the live bytes
+ */
+static void emit(out_t *out, int op, uint32_t id, uint32_t size, 
+		 uint32_t prev)
+{
+    evtrace_rec_t rec;
+    static const char tags[] = "afr";
+
+    if (op == ALLOC_OP)
+	out->num_ids++;
+    out->live_bytes += (uint64_t)size - prev;
+    if (out->live_bytes > out->peak_bytes)
+	out->peak_bytes = out->live_bytes;
+
+    if (out->len > OUTBUF - 64)
+	flush_out(out);
+    if (out->binary) {
+	memset(&rec, 0, sizeof(rec));
+	rec.ticks = out->num_ops;
+	rec.ptr = 16 * ((uint64_t)id + 1);
+	rec.old = op == REALLOC_OP ? rec.ptr : 0;
+	rec.size = size;
+	rec.op = op == ALLOC_OP ? EV_MALLOC : op == FREE_OP ? EV_FREE :
+	    EV_REALLOC;
+	memcpy(out->buf + out->len, &rec, sizeof(rec));
+	out->len += sizeof(rec);
+    }
+    else {
+	out->buf[out->len++] = tags[op];
+	out->buf[out->len++] = ' ';
+	put_num(out, id);
+	if (op != FREE_OP) {
+	    out->buf[out->len++] = ' ';
+	    put_num(out, size);
+	}
+	out->buf[out->len++] = '\n';
+    }
+    out->num_ops++;
+}
+
+/*
+ * put_num - Append val in decimal to the output buffer
+ */
+static void put_num(out_t *out, uint64_t val)
+{
+    char digits[24];
+    int i = sizeof(digits);
+
+    do {
+	digits[--i] = '0' + val % 10;
+	val /= 10;
+    } while (val > 0);
+    memcpy(out->buf + out->len, digits + i, sizeof(digits) - i);
+    out->len += sizeof(digits) - i;
+}
+
+/*
+ * flush_out - Write the buffered output
+ */
+static void flush_out(out_t *out)
+{
+    if (out->len > 0 && fwrite(out->buf, 1, out->len, out->fp) != out->len)
+	app_error("Write failed");
+    out->len = 0;
+}
+
+/*
+ * write_header - Write the header, padded to a fixed size so that it can
+ *     be rewritten with the final counts
+ */
+static void write_header(out_t *out)
+{
+    evtrace_hdr_t hdr;
+
+    if (out->binary) {
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, EVTRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = EVTRACE_VERSION;
+	hdr.num_threads = 1;
+	hdr.num_records = out->num_ops;
+	if (fwrite(&hdr, sizeof(hdr), 1, out->fp) != 1)
+	    app_error("Write failed");
+    }
+    else {
+	fprintf(out->fp, "%-*lu\n%-*lu\n%-*lu\n%-*d\n",
+		HDRWIDTH - 1, (unsigned long)out->peak_bytes,
+		HDRWIDTH - 1, (unsigned long)out->num_ids,
+		HDRWIDTH - 1, (unsigned long)out->num_ops,
+		HDRWIDTH - 1, 1);
+    }
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gen_trace [-bFh] [-n <ops>] [-s <seed>] "
+	    "[-z <sizes>] [-l <lives>]\n"
+	    "                 [-r <p>:<growth>:<steps>] [-p <ops>]... "
+	    "<outfile>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Write a binary trace (see ../evlog.h).\n");
+    fprintf(stderr, "\t-F         Free every live block when the phase "
+	    "ends.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l <lives> Lifetimes in allocations: exp:<mean>, "
+	    "uniform:<min>:<max>\n");
+    fprintf(stderr, "\t           or lognormal:<median>:<sigma> "
+	    "(default exp:1000).\n");
+    fprintf(stderr, "\t-n <ops>   Requests in the trace, without -p "
+	    "(default 100000).\n");
+    fprintf(stderr, "\t-p <ops>   End a phase of <ops> requests; the "
+	    "options after it apply\n");
+    fprintf(stderr, "\t           to the next phase.\n");
+    fprintf(stderr, "\t-r <p>:<growth>:<steps>\n");
+    fprintf(stderr, "\t           A block grows by realloc with chance "
+	    "<p>, by <growth> times\n");
+    fprintf(stderr, "\t           at each of <steps> reallocs over its "
+	    "life.\n");
+    fprintf(stderr, "\t-s <seed>  Seed the random numbers (default 1).\n");
+    fprintf(stderr, "\t-z <sizes> Sizes in bytes: uniform:<min>:<max>, "
+	    "lognormal:<median>:<sigma>,\n");
+    fprintf(stderr, "\t           zipf:<max>:<s> or hist:<file> "
+	    "(default uniform:1:32768).\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}